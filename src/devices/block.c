@@ -4,6 +4,10 @@
 #include <stdio.h>
 #include "devices/ide.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* A block device. */
 struct block
@@ -19,8 +23,31 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    /* Request queue.  Not used by devices that have a lower
+       device. */
+    struct lock queue_lock;             /* Protects the members below. */
+    struct condition queue_nonempty;    /* Signaled when QUEUE gains a
+                                           request. */
+    struct list queue;                  /* Pending block_requests, in
+                                           increasing sector order. */
+    block_sector_t next_sector;         /* Sector following the last
+                                           transfer. */
+
+    /* The batch of requests being transferred.  Owned by the
+       dispatcher thread, and by the driver's completion routine
+       while a transfer started with ops->start is in flight. */
+    struct block_request *batch[PGSIZE / BLOCK_SECTOR_SIZE];
+    size_t batch_cnt;                   /* Number of requests in BATCH. */
+    bool batch_ok;                      /* Did the transfer succeed? */
+    struct semaphore batch_done;        /* Up'd when the transfer ends. */
+    uint8_t *bounce;                    /* Buffer for merged requests. */
   };
 
+/* Most sectors moved by one transfer made of several merged
+   requests.  The dispatcher's bounce buffer is one page. */
+#define MERGE_MAX (PGSIZE / BLOCK_SECTOR_SIZE)
+
 /* List of all block devices. */
 static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 
@@ -28,6 +55,11 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void transfer (struct block *, block_sector_t, size_t cnt,
+                      void *buffer, bool write);
+static void sync_transfer (struct block *, block_sector_t, size_t cnt,
+                           void *buffer, bool write);
+static thread_func dispatcher NO_RETURN;
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -120,9 +152,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  sync_transfer (block, sector, 1, buffer, false);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -134,10 +164,292 @@ void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
   //printf("sector: %d\n\n", sector);
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  sync_transfer (block, sector, 1, (void *) buffer, true);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  If the driver supports it, this is a single transfer.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer)
+{
+  if (cnt > 0)
+    sync_transfer (block, sector, cnt, buffer, false);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving the
+   data.  If the driver supports it, this is a single transfer.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      size_t cnt, const void *buffer)
+{
+  if (cnt > 0)
+    sync_transfer (block, sector, cnt, (void *) buffer, true);
+}
+
+/* Initializes R as a request to move CNT sectors starting at
+   SECTOR between a block device and BUFFER: from BUFFER to the
+   device if WRITE is true, otherwise from the device into
+   BUFFER.  When the transfer is done, DONE is called with R and
+   AUX, unless DONE is null. */
+void
+block_request_init (struct block_request *r, block_sector_t sector,
+                    size_t cnt, void *buffer, bool write,
+                    block_done_func *done, void *aux)
+{
+  ASSERT (cnt > 0);
+
+  r->sector = sector;
+  r->cnt = cnt;
+  r->buffer = buffer;
+  r->write = write;
+  r->done = done;
+  r->aux = aux;
+  sema_init (&r->complete, 0);
+}
+
+/* Returns true if request A_ starts at a lower sector than
+   request B_. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+
+  return a->dev_sector < b->dev_sector;
+}
+
+/* Queues request R, which must have been initialized with
+   block_request_init(), for BLOCK and returns without waiting for
+   it.  R may be served along with BLOCK's other pending requests
+   in any order, so requests for overlapping sectors must not be
+   outstanding at the same time.  The buffer cache and swap never
+   do that.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  check_sector (block, r->sector);
+  check_sector (block, r->sector + r->cnt - 1);
+  if (r->write)
+    {
+      ASSERT (block->type != BLOCK_FOREIGN);
+      block->write_cnt += r->cnt;
+    }
+  else
+    block->read_cnt += r->cnt;
+
+  /* Hand the request down to the device that does the work. */
+  r->dev_sector = r->sector;
+  while (block->ops->lower != NULL)
+    {
+      block = block->ops->lower (block->aux, &r->dev_sector);
+      check_sector (block, r->dev_sector + r->cnt - 1);
+      if (r->write)
+        block->write_cnt += r->cnt;
+      else
+        block->read_cnt += r->cnt;
+    }
+
+  lock_acquire (&block->queue_lock);
+  list_insert_ordered (&block->queue, &r->elem, request_less, NULL);
+  cond_signal (&block->queue_nonempty, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Waits for request R, which must have been submitted with
+   block_submit(), to complete.  At most one thread may wait for
+   a given request. */
+void
+block_wait (struct block_request *r)
+{
+  sema_down (&r->complete);
+}
+
+/* Moves CNT sectors starting at SECTOR between BLOCK and BUFFER,
+   in the direction given by WRITE, by way of BLOCK's request
+   queue, and waits for the transfer to finish. */
+static void
+sync_transfer (struct block *block, block_sector_t sector, size_t cnt,
+               void *buffer, bool write)
+{
+  struct block_request r;
+
+  block_request_init (&r, sector, cnt, buffer, write, NULL, NULL);
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
+/* Has BLOCK's driver move CNT sectors starting at SECTOR between
+   the device and BUFFER, in the direction given by WRITE, and
+   waits for it to finish. */
+static void
+transfer (struct block *block, block_sector_t sector, size_t cnt,
+          void *buffer_, bool write)
+{
+  uint8_t *buffer = buffer_;
+  size_t i;
+
+  if (write && block->ops->write_multiple != NULL)
+    block->ops->write_multiple (block->aux, sector, cnt, buffer);
+  else if (!write && block->ops->read_multiple != NULL)
+    block->ops->read_multiple (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      if (write)
+        block->ops->write (block->aux, sector + i,
+                           buffer + i * BLOCK_SECTOR_SIZE);
+      else
+        block->ops->read (block->aux, sector + i,
+                          buffer + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Removes the next requests to serve from BLOCK's queue, which
+   must not be empty, and stores them in BLOCK's batch.
+
+   The queue is served in C-LOOK order: the request at the
+   lowest sector at or past the end of the previous transfer goes
+   next, wrapping around to the lowest sector when there is
+   none.  Requests that continue exactly where it ends, in the
+   same direction, are merged with it as long as the total fits
+   in MERGE_MAX sectors. */
+static void
+next_batch (struct block *block)
+{
+  struct list_elem *e;
+  struct block_request *r;
+  block_sector_t end;
+  size_t sector_cnt;
+
+  ASSERT (lock_held_by_current_thread (&block->queue_lock));
+  ASSERT (!list_empty (&block->queue));
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    if (list_entry (e, struct block_request, elem)->dev_sector
+        >= block->next_sector)
+      break;
+  if (e == list_end (&block->queue))
+    e = list_begin (&block->queue);
+
+  r = list_entry (e, struct block_request, elem);
+  e = list_remove (e);
+  block->batch[0] = r;
+  block->batch_cnt = 1;
+  sector_cnt = r->cnt;
+  end = r->dev_sector + r->cnt;
+
+  while (e != list_end (&block->queue) && block->batch_cnt < MERGE_MAX)
+    {
+      struct block_request *next = list_entry (e, struct block_request, elem);
+      if (next->dev_sector != end || next->write != r->write
+          || sector_cnt + next->cnt > MERGE_MAX)
+        break;
+      e = list_remove (e);
+      block->batch[block->batch_cnt++] = next;
+      sector_cnt += next->cnt;
+      end += next->cnt;
+    }
+
+  block->next_sector = end;
+}
+
+/* Completes every request in BLOCK's batch, copying data in from
+   the bounce buffer first if several reads were merged.  May run
+   in an interrupt handler. */
+static void
+finish_batch (struct block *block)
+{
+  size_t i, ofs;
+
+  if (block->batch_cnt > 1 && !block->batch[0]->write)
+    for (i = ofs = 0; i < block->batch_cnt; ofs += block->batch[i++]->cnt)
+      memcpy (block->batch[i]->buffer, block->bounce + ofs * BLOCK_SECTOR_SIZE,
+              block->batch[i]->cnt * BLOCK_SECTOR_SIZE);
+
+  for (i = 0; i < block->batch_cnt; i++)
+    {
+      struct block_request *r = block->batch[i];
+      if (r->done != NULL)
+        r->done (r, r->aux);
+      sema_up (&r->complete);
+    }
+}
+
+/* Called by the driver, typically from its interrupt handler,
+   when a transfer started with ops->start finishes.  If it
+   failed, the dispatcher retries it synchronously. */
+static void
+start_done (void *block_, bool success)
+{
+  struct block *block = block_;
+
+  block->batch_ok = success;
+  if (success)
+    finish_batch (block);
+  sema_up (&block->batch_done);
+}
+
+/* Dispatcher thread for block device BLOCK_.  Serves the
+   requests in its queue one batch at a time, in the order chosen
+   by next_batch().  A batch of several requests is moved through
+   a bounce buffer in one transfer.  If the driver can start the
+   transfer and finish it from its interrupt handler, the
+   requests are completed from there. */
+static void
+dispatcher (void *block_)
+{
+  struct block *block = block_;
+
+  block->bounce = palloc_get_page (PAL_ASSERT);
+  for (;;)
+    {
+      struct block_request *first;
+      void *buffer;
+      size_t cnt, i;
+
+      lock_acquire (&block->queue_lock);
+      while (list_empty (&block->queue))
+        cond_wait (&block->queue_nonempty, &block->queue_lock);
+      next_batch (block);
+      lock_release (&block->queue_lock);
+
+      first = block->batch[0];
+      if (block->batch_cnt == 1)
+        {
+          buffer = first->buffer;
+          cnt = first->cnt;
+        }
+      else
+        {
+          buffer = block->bounce;
+          for (i = cnt = 0; i < block->batch_cnt; cnt += block->batch[i++]->cnt)
+            if (first->write)
+              memcpy (block->bounce + cnt * BLOCK_SECTOR_SIZE,
+                      block->batch[i]->buffer,
+                      block->batch[i]->cnt * BLOCK_SECTOR_SIZE);
+        }
+
+      if (block->ops->start != NULL
+          && block->ops->start (block->aux, first->dev_sector, cnt, buffer,
+                                first->write, start_done, block))
+        {
+          sema_down (&block->batch_done);
+          if (block->batch_ok)
+            continue;
+        }
+      transfer (block, first->dev_sector, cnt, buffer, first->write);
+      finish_batch (block);
+    }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -201,6 +513,19 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  lock_init (&block->queue_lock);
+  cond_init (&block->queue_nonempty);
+  list_init (&block->queue);
+  block->next_sector = 0;
+  block->batch_cnt = 0;
+  sema_init (&block->batch_done, 0);
+  block->bounce = NULL;
+  if (ops->lower == NULL)
+    {
+      char thread_name[16];
+      snprintf (thread_name, sizeof thread_name, "blk-%.11s", block->name);
+      thread_create (thread_name, PRI_MAX, dispatcher, block);
+    }
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -1,8 +1,11 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,9 +56,45 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous I/O.
+
+   block_submit() queues a request and returns at once.  When
+   the transfer is done, the request's DONE function, if any, is
+   called, and then anyone waiting in block_wait() is woken.
+   DONE may be called from an interrupt handler, so it must not
+   sleep.  The request and its buffer must stay put until then. */
+struct block_request;
+typedef void block_done_func (struct block_request *, void *aux);
+
+struct block_request
+  {
+    /* Set by block_request_init(). */
+    block_sector_t sector;      /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+    void *buffer;               /* CNT * BLOCK_SECTOR_SIZE bytes of data. */
+    bool write;                 /* True to write, false to read. */
+    block_done_func *done;      /* Called on completion, or null. */
+    void *aux;                  /* Passed to DONE. */
+
+    /* Owned by the block layer. */
+    block_sector_t dev_sector;  /* SECTOR on the device that queues it. */
+    struct list_elem elem;      /* Element in a device's queue. */
+    struct semaphore complete;  /* Up'd when the transfer is done. */
+  };
+
+void block_request_init (struct block_request *, block_sector_t,
+                         size_t cnt, void *buffer, bool write,
+                         block_done_func *, void *aux);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
 
@@ -63,8 +102,37 @@ void block_print_stats (void);
 
 struct block_operations
   {
+    /* Transfer one sector.  Required, except for a device with
+       LOWER, whose requests never reach its own driver. */
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Transfer CNT consecutive sectors at once.  Optional: if
+       null, the block layer calls READ or WRITE once per
+       sector. */
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
+
+    /* Starts moving CNT sectors between the device and BUFFER,
+       in the direction given by WRITE, and returns without
+       waiting.  When the transfer finishes, the driver calls
+       DONE, possibly from an interrupt handler, passing DONE_AUX
+       and whether it succeeded.  Returns false, without starting
+       anything, if the driver can't do this transfer
+       asynchronously, in which case the block layer uses the
+       functions above.  Optional. */
+    bool (*start) (void *aux, block_sector_t, size_t cnt, void *buffer,
+                   bool write, void (*done) (void *done_aux, bool success),
+                   void *done_aux);
+
+    /* For a device that only passes requests on to another block
+       device, as a partition does: returns that device and
+       translates *SECTOR into a sector on it.  Such a device has
+       no request queue of its own; the device underneath orders
+       the requests.  Null for other devices. */
+    struct block *(*lower) (void *aux, block_sector_t *sector);
   };
 
 struct block *block_register (const char *name, enum block_type,
@@ -0,0 +1,211 @@
+#include "devices/hrtimer.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+
+/* Time base.  hrtimer_now() counts nanoseconds since boot from
+   the CPU's time-stamp counter, whose rate hrtimer_calibrate()
+   measures against the timer tick.  Before calibration it falls
+   back to whole timer ticks. */
+static uint64_t tsc_hz;         /* TSC cycles per second, or 0. */
+static uint64_t tsc_base;       /* TSC value at NS_BASE. */
+static int64_t ns_base;         /* hrtimer_now() at TSC_BASE. */
+
+/* Number of timer ticks to measure the TSC over. */
+#define CALIBRATE_TICKS 4
+
+/* Pending hrtimers, in order of increasing deadline.
+   Protected by disabling interrupts. */
+static struct list pending_list;
+
+static list_less_func expires_less;
+static hrtimer_func wake_sleeper;
+
+/* Returns the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Measures the time-stamp counter's rate against the timer tick
+   and starts using it for hrtimer_now().  Interrupts must be on,
+   and the timer must still be interrupting every tick. */
+void
+hrtimer_calibrate (void)
+{
+  int64_t start, end;
+  uint64_t tsc_start, tsc_end;
+
+  ASSERT (intr_get_level () == INTR_ON);
+  list_init (&pending_list);
+
+  /* Wait for a tick boundary, then time CALIBRATE_TICKS ticks. */
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    barrier ();
+  start++;
+  tsc_start = rdtsc ();
+  while (timer_ticks () < start + CALIBRATE_TICKS)
+    barrier ();
+  tsc_end = rdtsc ();
+  end = start + CALIBRATE_TICKS;
+
+  intr_disable ();
+  tsc_hz = (tsc_end - tsc_start) * TIMER_FREQ / CALIBRATE_TICKS;
+  tsc_base = tsc_end;
+  ns_base = end * TIMER_TICK_NS;
+  intr_enable ();
+
+  printf ("Time-stamp counter: %'"PRIu64" Hz.\n", tsc_hz);
+}
+
+/* Returns the number of nanoseconds since boot. */
+int64_t
+hrtimer_now (void)
+{
+  uint64_t cycles;
+
+  if (tsc_hz == 0)
+    return timer_ticks () * TIMER_TICK_NS;
+
+  /* Split the conversion so that it cannot overflow. */
+  cycles = rdtsc () - tsc_base;
+  return (ns_base + cycles / tsc_hz * 1000000000
+          + cycles % tsc_hz * 1000000000 / tsc_hz);
+}
+
+/* Initializes hrtimer T, which is not pending, to call FUNC with
+   AUX when it expires. */
+void
+hrtimer_init (struct hrtimer *t, hrtimer_func *func, void *aux)
+{
+  ASSERT (t != NULL);
+  ASSERT (func != NULL);
+
+  t->func = func;
+  t->aux = aux;
+  t->pending = false;
+}
+
+/* Arms T to expire at EXPIRES, a value on hrtimer_now()'s scale,
+   replacing any deadline it was already pending for.  A deadline
+   in the past expires at the next timer interrupt.
+
+   This function may be called from an interrupt handler,
+   including from an hrtimer's own function. */
+void
+hrtimer_start (struct hrtimer *t, int64_t expires)
+{
+  enum intr_level old_level;
+
+  ASSERT (t != NULL);
+  ASSERT (tsc_hz != 0);
+
+  old_level = intr_disable ();
+  if (t->pending)
+    list_remove (&t->elem);
+  t->expires = expires;
+  t->pending = true;
+  list_insert_ordered (&pending_list, &t->elem, expires_less, NULL);
+  if (list_front (&pending_list) == &t->elem)
+    timer_reprogram ();
+  intr_set_level (old_level);
+}
+
+/* Disarms T.  Returns true if it was pending, false if it had
+   already expired or was never started. */
+bool
+hrtimer_cancel (struct hrtimer *t)
+{
+  enum intr_level old_level;
+  bool was_pending;
+
+  ASSERT (t != NULL);
+
+  old_level = intr_disable ();
+  was_pending = t->pending;
+  if (was_pending)
+    {
+      list_remove (&t->elem);
+      t->pending = false;
+    }
+  intr_set_level (old_level);
+  return was_pending;
+}
+
+/* Blocks the current thread for approximately NS nanoseconds.
+   Interrupts must be turned on. */
+void
+hrtimer_sleep (int64_t ns)
+{
+  struct semaphore sema;
+  struct hrtimer t;
+
+  ASSERT (intr_get_level () == INTR_ON);
+  if (ns <= 0)
+    return;
+
+  sema_init (&sema, 0);
+  hrtimer_init (&t, wake_sleeper, &sema);
+  hrtimer_start (&t, hrtimer_now () + ns);
+  sema_down (&sema);
+}
+
+/* Returns the deadline of the earliest pending hrtimer, or
+   INT64_MAX if none is pending.  Interrupts must be off. */
+int64_t
+hrtimer_next_expiry (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (tsc_hz == 0 || list_empty (&pending_list))
+    return INT64_MAX;
+  return list_entry (list_front (&pending_list),
+                     struct hrtimer, elem)->expires;
+}
+
+/* Calls the function of every pending hrtimer whose deadline is
+   no later than NOW.  Called by the timer interrupt handler. */
+void
+hrtimer_run (int64_t now)
+{
+  ASSERT (intr_context ());
+
+  if (tsc_hz == 0)
+    return;
+  while (!list_empty (&pending_list))
+    {
+      struct hrtimer *t = list_entry (list_front (&pending_list),
+                                      struct hrtimer, elem);
+      if (t->expires > now)
+        break;
+      list_pop_front (&pending_list);
+      t->pending = false;
+      t->func (t, t->aux);
+    }
+}
+
+/* Returns true if the hrtimer that A is embedded in expires
+   before the one B is embedded in. */
+static bool
+expires_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct hrtimer *a = list_entry (a_, struct hrtimer, elem);
+  const struct hrtimer *b = list_entry (b_, struct hrtimer, elem);
+
+  return a->expires < b->expires;
+}
+
+/* hrtimer function for hrtimer_sleep(): wakes the sleeper. */
+static void
+wake_sleeper (struct hrtimer *t UNUSED, void *sema)
+{
+  sema_up (sema);
+}
@@ -0,0 +1,43 @@
+#ifndef DEVICES_HRTIMER_H
+#define DEVICES_HRTIMER_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* High-resolution timers.
+
+   An hrtimer calls a function from the timer interrupt handler
+   at a deadline given in nanoseconds since boot, rather than in
+   whole timer ticks.  Pending hrtimers are kept in order of
+   deadline, and devices/timer.c programs the PIT to interrupt at
+   the earliest one. */
+
+struct hrtimer;
+
+/* Function called when an hrtimer expires, from the timer
+   interrupt handler. */
+typedef void hrtimer_func (struct hrtimer *, void *aux);
+
+struct hrtimer
+  {
+    struct list_elem elem;      /* Element in the pending list. */
+    int64_t expires;            /* Deadline, per hrtimer_now(). */
+    hrtimer_func *func;         /* Function to call. */
+    void *aux;                  /* Passed to FUNC. */
+    bool pending;               /* In the pending list? */
+  };
+
+void hrtimer_calibrate (void);
+int64_t hrtimer_now (void);
+
+void hrtimer_init (struct hrtimer *, hrtimer_func *, void *aux);
+void hrtimer_start (struct hrtimer *, int64_t expires);
+bool hrtimer_cancel (struct hrtimer *);
+void hrtimer_sleep (int64_t ns);
+
+/* For devices/timer.c. */
+int64_t hrtimer_next_expiry (void);
+void hrtimer_run (int64_t now);
+
+#endif /* devices/hrtimer.h */
@@ -3,15 +3,24 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   If the controller is a PCI bus-master IDE controller, such as
+   the Intel PIIX emulated by QEMU and Bochs, sectors are moved by
+   DMA, so the CPU does not copy them through the data port.
+   Otherwise, or for buffers the controller can't reach, it falls
+   back to programmed I/O. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -34,6 +43,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +59,51 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* PCI configuration space access. */
+#define PCI_CONFIG_ADDR 0xcf8           /* Address port. */
+#define PCI_CONFIG_DATA 0xcfc           /* Data port. */
+#define PCI_REG_ID 0x00                 /* Vendor and device ID. */
+#define PCI_REG_COMMAND 0x04            /* Command register. */
+#define PCI_REG_CLASS 0x08              /* Class, subclass, prog-if. */
+#define PCI_REG_BAR4 0x20               /* Base address register 4. */
+#define PCI_CMD_IO 0x0001               /* Respond to I/O accesses. */
+#define PCI_CMD_MASTER 0x0004           /* Enable bus mastering. */
+
+/* Bus-master IDE registers, relative to a channel's bm_base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus-master Command Register bits. */
+#define BM_START 0x01           /* Start transfer. */
+#define BM_READ 0x08            /* Transfer from disk to memory. */
+
+/* Bus-master Status Register bits. */
+#define BM_ACTIVE 0x01          /* Transfer in progress. */
+#define BM_ERROR 0x02           /* Transfer failed (write 1 to clear). */
+#define BM_INTR 0x04            /* Disk interrupted (write 1 to clear). */
+
+/* A Physical Region Descriptor, which tells the bus master about
+   one physically contiguous piece of a transfer.  A region may
+   not cross a 64 kB boundary.  A byte count of 0 means 64 kB. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address of region. */
+    uint16_t size;              /* Size of region in bytes. */
+    uint16_t flags;             /* PRD_EOT in the last entry. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
+
+/* Most sectors moved by a single READ or WRITE command.  A
+   sector count of 0 in the command means 256. */
+#define MAX_XFER_SECTORS 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +112,9 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt with READ/WRITE
+                                   MULTIPLE, or 0 if not in use. */
+    bool dma;                   /* Transfer by DMA? */
   };
 
 /* An ATA channel (aka controller).
@@ -67,11 +125,25 @@ struct channel
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
 
-    struct lock lock;           /* Must acquire to access the controller. */
+    struct semaphore avail;     /* Down to access the controller.  A
+                                   semaphore, not a lock, because an
+                                   asynchronous transfer releases it
+                                   from the interrupt handler. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus-master I/O base, or 0 if none. */
+    struct prd *prdt;           /* PRD table for DMA, one page. */
+
+    /* Asynchronous DMA transfer in flight, if ASYNC_DONE is
+       non-null.  See ide_start(). */
+    void (*async_done) (void *, bool);  /* Called when it finishes. */
+    void *async_aux;                    /* Passed to ASYNC_DONE. */
+    struct ata_disk *async_disk;        /* Disk being transferred. */
+    block_sector_t async_sector;        /* First sector. */
+    bool async_write;                   /* Direction. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -81,14 +153,22 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+static uint16_t find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static void set_multiple_mode (struct ata_disk *, int max);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
+static bool dma_usable (const struct ata_disk *, const void *buffer);
+static void dma_start (struct ata_disk *, block_sector_t, size_t cnt,
+                       void *buffer, bool write);
+static bool dma_finish (struct ata_disk *, block_sector_t, bool write);
+static bool dma_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          void *buffer, bool write);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
@@ -101,6 +181,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -123,9 +204,17 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
+      sema_init (&c->avail, 1);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->bm_base = 0;
+      c->prdt = NULL;
+      c->async_done = NULL;
+      if (bm_base != 0)
+        {
+          c->bm_base = bm_base + chan_no * 8;
+          c->prdt = palloc_get_page (PAL_ASSERT);
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +225,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -157,6 +248,63 @@ ide_init (void)
 
 /* Disk detection and identification. */
 
+/* Reads the 32-bit register at offset REG in the configuration
+   space of PCI function FN of device DEV on bus BUS. */
+static uint32_t
+pci_read_config (int bus, int dev, int fn, int reg)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (fn << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit register at offset REG in the
+   configuration space of PCI function FN of device DEV on bus
+   BUS. */
+static void
+pci_write_config (int bus, int dev, int fn, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (fn << 8) | reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that runs the legacy
+   channels in compatibility mode and can act as bus master.
+   If there is one, enables bus mastering and returns the base of
+   its bus-master I/O registers.  Otherwise, returns 0. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, fn;
+
+  for (dev = 0; dev < 32; dev++)
+    for (fn = 0; fn < 8; fn++)
+      {
+        uint32_t class, bar4, command;
+
+        if ((pci_read_config (0, dev, fn, PCI_REG_ID) & 0xffff) == 0xffff)
+          continue;
+
+        /* Mass storage (01), IDE (01), compatibility mode on both
+           channels (prog-if bits 0 and 2 clear), bus master
+           capable (prog-if bit 7). */
+        class = pci_read_config (0, dev, fn, PCI_REG_CLASS) >> 8;
+        if ((class >> 8) != 0x0101 || (class & 0x85) != 0x80)
+          continue;
+
+        bar4 = pci_read_config (0, dev, fn, PCI_REG_BAR4);
+        if ((bar4 & 1) == 0 || (bar4 & 0xfff0) == 0)
+          continue;
+
+        command = pci_read_config (0, dev, fn, PCI_REG_COMMAND);
+        pci_write_config (0, dev, fn, PCI_REG_COMMAND,
+                          command | PCI_CMD_IO | PCI_CMD_MASTER);
+        return bar4 & 0xfff0;
+      }
+  return 0;
+}
+
 static char *descramble_ata_string (char *, int size);
 
 /* Resets an ATA channel and waits for any devices present on it
@@ -303,12 +451,45 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Word 47 gives the most sectors the disk can move per
+     interrupt with READ/WRITE MULTIPLE.  Bit 8 of word 49 says
+     whether the disk can do DMA at all. */
+  set_multiple_mode (d, (uint8_t) id[47 * 2]);
+  d->dma = c->bm_base != 0 && (id[49 * 2 + 1] & 0x01) != 0;
+  if (d->dma)
+    strlcat (extra_info, ", DMA", sizeof extra_info);
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
 
+/* Turns on READ/WRITE MULTIPLE for disk D, moving as many
+   sectors per interrupt as the largest power of 2 not greater
+   than MAX.  Leaves D using one sector per interrupt if MAX is
+   less than 2 or the disk rejects the command. */
+static void
+set_multiple_mode (struct ata_disk *d, int max)
+{
+  struct channel *c = d->channel;
+  int cnt;
+
+  d->multiple = 0;
+  if (max < 2)
+    return;
+  for (cnt = 1; cnt * 2 <= max; cnt *= 2)
+    continue;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), cnt);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_status (c)) & STA_ERR) == 0)
+    d->multiple = cnt;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,23 +518,111 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.  Uses
+   READ MULTIPLE, so that the disk interrupts once per
+   d->multiple sectors rather than once per sector, if the disk
+   supports it.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                   void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  uint8_t *buffer = buffer_;
+  size_t per_intr = d->multiple > 0 ? d->multiple : 1;
+
+  sema_down (&c->avail);
+  while (cnt > 0)
+    {
+      size_t xfer = cnt < MAX_XFER_SECTORS ? cnt : MAX_XFER_SECTORS;
+      size_t done, i;
+
+      if (dma_transfer (d, sec_no, xfer, buffer, false))
+        buffer += xfer * BLOCK_SECTOR_SIZE;
+      else
+        {
+          select_sector (d, sec_no, xfer);
+          issue_pio_command (c, (d->multiple > 0
+                                 ? CMD_READ_MULTIPLE
+                                 : CMD_READ_SECTOR_RETRY));
+          for (done = 0; done < xfer; done += i)
+            {
+              sema_down (&c->completion_wait);
+              if (!wait_while_busy (d))
+                PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                       d->name, sec_no + done);
+              for (i = 0; i < per_intr && done + i < xfer; i++)
+                {
+                  input_sector (c, buffer);
+                  buffer += BLOCK_SECTOR_SIZE;
+                }
+            }
+        }
+      sec_no += xfer;
+      cnt -= xfer;
+    }
+  sema_up (&c->avail);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving the data.  Uses
+   WRITE MULTIPLE if the disk supports it.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *buffer_)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  const uint8_t *buffer = buffer_;
+  size_t per_intr = d->multiple > 0 ? d->multiple : 1;
+
+  sema_down (&c->avail);
+  while (cnt > 0)
+    {
+      size_t xfer = cnt < MAX_XFER_SECTORS ? cnt : MAX_XFER_SECTORS;
+      size_t done, i;
+
+      if (dma_transfer (d, sec_no, xfer, (void *) buffer, true))
+        buffer += xfer * BLOCK_SECTOR_SIZE;
+      else
+        {
+          select_sector (d, sec_no, xfer);
+          issue_pio_command (c, (d->multiple > 0
+                                 ? CMD_WRITE_MULTIPLE
+                                 : CMD_WRITE_SECTOR_RETRY));
+          for (done = 0; done < xfer; done += i)
+            {
+              if (!wait_while_busy (d))
+                PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                       d->name, sec_no + done);
+              for (i = 0; i < per_intr && done + i < xfer; i++)
+                {
+                  output_sector (c, buffer);
+                  buffer += BLOCK_SECTOR_SIZE;
+                }
+              sema_down (&c->completion_wait);
+            }
+        }
+      sec_no += xfer;
+      cnt -= xfer;
+    }
+  sema_up (&c->avail);
+}
+
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  ide_read_multiple (d, sec_no, 1, buffer);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -362,38 +631,61 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_multiple (d, sec_no, 1, buffer);
+}
+
+/* Starts moving CNT sectors starting at SEC_NO between disk D
+   and BUFFER by DMA, from BUFFER to the disk if WRITE is true and
+   the other way otherwise, and returns true without waiting.
+   When the transfer is over, the interrupt handler calls DONE
+   with DONE_AUX and whether it succeeded.  Returns false, without
+   doing anything, if the transfer can't be done by DMA. */
+static bool
+ide_start (void *d_, block_sector_t sec_no, size_t cnt, void *buffer,
+           bool write, void (*done) (void *, bool), void *done_aux)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+
+  if (cnt > MAX_XFER_SECTORS || !dma_usable (d, buffer))
+    return false;
+
+  sema_down (&c->avail);
+  c->async_done = done;
+  c->async_aux = done_aux;
+  c->async_disk = d;
+  c->async_sector = sec_no;
+  c->async_write = write;
+  dma_start (d, sec_no, cnt, buffer, write);
+  return true;
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple,
+    ide_start,
+    NULL
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT, which must be between
+   1 and MAX_XFER_SECTORS, to the disk's sector selection
+   registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= MAX_XFER_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -430,6 +722,99 @@ output_sector (struct channel *c, const void *sector)
   outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
 }
 
+/* Returns true if disk D can move data to or from BUFFER by
+   DMA.  The bus master needs a physically contiguous, 2-byte
+   aligned buffer.  Kernel virtual memory maps physical memory
+   linearly, so any kernel buffer is contiguous. */
+static bool
+dma_usable (const struct ata_disk *d, const void *buffer)
+{
+  return d->dma && is_kernel_vaddr (buffer) && ((uintptr_t) buffer & 1) == 0;
+}
+
+/* Starts moving CNT sectors starting at SEC_NO between disk D
+   and BUFFER by bus-master DMA: from BUFFER to the disk if WRITE
+   is true, otherwise from the disk into BUFFER.  The disk
+   interrupts when the transfer is over, after which the caller
+   must call dma_finish().  dma_usable() must be true of D and
+   BUFFER, and the caller must have D's channel. */
+static void
+dma_start (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+           void *buffer, bool write)
+{
+  struct channel *c = d->channel;
+  uintptr_t paddr, end;
+  size_t prd_cnt;
+
+  ASSERT (dma_usable (d, buffer));
+
+  /* Describe the buffer, splitting it at 64 kB boundaries. */
+  paddr = vtop (buffer);
+  end = paddr + cnt * BLOCK_SECTOR_SIZE;
+  for (prd_cnt = 0; paddr < end; prd_cnt++)
+    {
+      uintptr_t next = (paddr | 0xffff) + 1;
+      if (next > end)
+        next = end;
+      ASSERT (prd_cnt < PRD_CNT);
+      c->prdt[prd_cnt].addr = paddr;
+      c->prdt[prd_cnt].size = next - paddr;
+      c->prdt[prd_cnt].flags = 0;
+      paddr = next;
+    }
+  c->prdt[prd_cnt - 1].flags = PRD_EOT;
+
+  /* Program the bus master, then the disk, then start. */
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), write ? 0 : BM_READ);
+  outb (reg_bm_status (c), inb (reg_bm_status (c)) | BM_ERROR | BM_INTR);
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), (write ? 0 : BM_READ) | BM_START);
+}
+
+/* Stops the bus master after the DMA transfer started on disk D
+   at SEC_NO by dma_start() has interrupted, and returns true if
+   it succeeded.  If it failed, turns off DMA for D, so that
+   later transfers use programmed I/O.  May be called from the
+   interrupt handler. */
+static bool
+dma_finish (struct ata_disk *d, block_sector_t sec_no, bool write)
+{
+  struct channel *c = d->channel;
+  uint8_t status;
+
+  outb (reg_bm_command (c), 0);
+  status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), status | BM_ERROR | BM_INTR);
+  if ((status & BM_ERROR) != 0 || (inb (reg_status (c)) & STA_ERR) != 0)
+    {
+      printf ("%s: DMA %s failed, sector=%"PRDSNu", using PIO\n",
+              d->name, write ? "write" : "read", sec_no);
+      d->dma = false;
+      return false;
+    }
+  return true;
+}
+
+/* Moves CNT sectors starting at SEC_NO between disk D and
+   BUFFER by bus-master DMA, as dma_start(), and waits for the
+   transfer to finish.  The caller must have D's channel.
+   Returns true if successful.  Returns false, without having
+   touched the disk, if D or BUFFER is not suitable for DMA, or
+   if the transfer failed, so that the caller can retry with
+   programmed I/O. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              void *buffer, bool write)
+{
+  if (!dma_usable (d, buffer))
+    return false;
+  dma_start (d, sec_no, cnt, buffer, write);
+  sema_down (&d->channel->completion_wait);
+  return dma_finish (d, sec_no, write);
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -489,7 +874,7 @@ select_device (const struct ata_disk *d)
     dev |= DEV_DEV;
   outb (reg_device (c), dev);
   inb (reg_alt_status (c));
-  timer_nsleep (400);
+  timer_ndelay (400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
@@ -511,7 +896,21 @@ interrupt_handler (struct intr_frame *f)
   for (c = channels; c < channels + CHANNEL_CNT; c++)
     if (f->vec_no == c->irq)
       {
-        if (c->expecting_interrupt) 
+        if (c->expecting_interrupt && c->async_done != NULL)
+          {
+            /* Finish an asynchronous transfer, give up the
+               channel, and report to whoever started it. */
+            void (*done) (void *, bool) = c->async_done;
+            bool success;
+
+            inb (reg_status (c));               /* Acknowledge interrupt. */
+            success = dma_finish (c->async_disk, c->async_sector,
+                                  c->async_write);
+            c->async_done = NULL;
+            sema_up (&c->avail);
+            done (c->async_aux, success);
+          }
+        else if (c->expecting_interrupt) 
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
             sema_up (&c->completion_wait);      /* Wake up waiter. */
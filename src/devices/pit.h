@@ -3,6 +3,10 @@
 
 #include <stdint.h>
 
+/* PIT cycles per second. */
+#define PIT_HZ 1193180
+
 void pit_configure_channel (int channel, int mode, int frequency);
+void pit_oneshot (unsigned count);
 
 #endif /* devices/pit.h */
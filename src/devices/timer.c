@@ -1,8 +1,10 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
+#include "devices/hrtimer.h"
 #include "devices/pit.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
@@ -20,6 +22,32 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* Threads blocked in timer_sleep(), in order of increasing
+   wakeup_tick.  Protected by disabling interrupts. */
+static struct list sleep_list;
+
+/* Clock events.  Until timer_calibrate() has measured the
+   hrtimer time base, the PIT interrupts every tick.  After that
+   it runs in one-shot mode, and every interrupt programs it for
+   the earliest of the next tick and the first pending hrtimer,
+   so hrtimers expire between ticks.  Ticks are counted by
+   comparing hrtimer_now() against next_tick_ns, so an interrupt
+   that comes early or late does no harm.
+
+   While the idle thread halts, ticks with nothing to do are
+   skipped: the next interrupt is set for when the first sleeper
+   is due (or as late as the 16-bit counter allows), and the
+   ticks that pass meanwhile are counted when it, or any other
+   interrupt, ends the idle period. */
+#define ONESHOT_MAX_NS ((int64_t) 65536 * 1000000000 / PIT_HZ)
+static bool oneshot_mode;       /* PIT in one-shot mode? */
+static int64_t next_tick_ns;    /* hrtimer_now() when next tick is due. */
+static bool idle_skip;          /* Skipping ticks while idle? */
+
+static void count_ticks (bool run_tick);
+static bool wake_sleepers (void);
+static void program_next_event (void);
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
@@ -29,12 +57,14 @@ static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static list_less_func wakeup_less;
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void) 
 {
+  list_init (&sleep_list);
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
@@ -65,6 +95,15 @@ timer_calibrate (void)
       loops_per_tick |= test_bit;
 
   printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+  /* Calibrate the hrtimer time base and switch the PIT to
+     one-shot mode. */
+  hrtimer_calibrate ();
+  intr_disable ();
+  oneshot_mode = true;
+  next_tick_ns = hrtimer_now () + TIMER_TICK_NS;
+  program_next_event ();
+  intr_enable ();
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -86,15 +125,66 @@ timer_elapsed (int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The thread blocks on sleep_list until the timer interrupt
+   handler wakes it, so it costs nothing while it sleeps. */
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->wakeup_tick = timer_ticks () + ticks;
+  list_insert_ordered (&sleep_list, &cur->elem, wakeup_less, NULL);
+  thread_block ();
+  intr_set_level (old_level);
+}
+
+/* Called by the idle thread, with interrupts off, just before it
+   halts.  Stops the tick until the next sleeper is due.
+
+   Not used by the multi-level feedback queue scheduler, which
+   needs to see every tick. */
+void
+timer_idle_enter (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (!oneshot_mode || thread_mlfqs)
+    return;
+
+  idle_skip = true;
+  program_next_event ();
+}
+
+/* Called with interrupts off when the idle thread stops
+   running.  Counts the ticks that passed while it halted and
+   restarts the tick. */
+void
+timer_idle_exit (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (!idle_skip)
+    return;
+
+  idle_skip = false;
+  count_ticks (false);
+  program_next_event ();
+}
+
+/* Reprograms the PIT after the earliest pending hrtimer has
+   changed.  Interrupts must be off. */
+void
+timer_reprogram (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (oneshot_mode)
+    program_next_event ();
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -167,12 +257,119 @@ timer_print_stats (void)
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
-/* Timer interrupt handler. */
+/* Timer interrupt handler.  Counts any ticks that are due,
+   letting the scheduler account for each, wakes the threads
+   whose sleep has run out, and runs expired hrtimers. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
-  ticks++;
-  thread_tick ();
+  bool woke;
+
+  if (oneshot_mode)
+    {
+      count_ticks (true);
+      hrtimer_run (hrtimer_now ());
+    }
+  else
+    {
+      ticks++;
+      thread_tick ();
+    }
+  woke = wake_sleepers ();
+  if (oneshot_mode)
+    program_next_event ();
+  if (woke)
+    thread_preempt ();
+}
+
+/* Adds to `ticks' every tick that has come due in one-shot
+   mode.  One interrupt may cover several ticks, so if RUN_TICK
+   is true, calls thread_tick() once per tick, with `ticks' at
+   that tick's value, so that the scheduler's per-second and
+   per-slice accounting skips none of them.  RUN_TICK must be
+   false outside the timer interrupt. */
+static void
+count_ticks (bool run_tick)
+{
+  int64_t now = hrtimer_now ();
+
+  while (now >= next_tick_ns)
+    {
+      ticks++;
+      next_tick_ns += TIMER_TICK_NS;
+      if (run_tick)
+        thread_tick ();
+    }
+}
+
+/* Unblocks the sleeping threads whose wakeup tick has come.
+   Returns true if there were any. */
+static bool
+wake_sleepers (void)
+{
+  bool woke = false;
+
+  while (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_tick > ticks)
+        break;
+      list_pop_front (&sleep_list);
+      thread_unblock (t);
+      woke = true;
+    }
+  return woke;
+}
+
+/* Programs the PIT to interrupt at the next clock event: the
+   next tick (or, while idle, the tick the first sleeper wakes
+   at) or the first pending hrtimer, whichever is earlier.
+   Interrupts must be off. */
+static void
+program_next_event (void)
+{
+  int64_t deadline = next_tick_ns;
+  int64_t delta;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (idle_skip)
+    {
+      if (list_empty (&sleep_list))
+        deadline = INT64_MAX;
+      else
+        {
+          struct thread *t = list_entry (list_front (&sleep_list),
+                                         struct thread, elem);
+          if (t->wakeup_tick > ticks)
+            deadline += (t->wakeup_tick - ticks - 1) * TIMER_TICK_NS;
+        }
+    }
+  if (hrtimer_next_expiry () < deadline)
+    deadline = hrtimer_next_expiry ();
+
+  /* Round up, so that the interrupt does not come before the
+     deadline. */
+  delta = deadline - hrtimer_now ();
+  if (delta <= 0)
+    pit_oneshot (1);
+  else if (delta >= ONESHOT_MAX_NS)
+    pit_oneshot (65536);
+  else
+    pit_oneshot (DIV_ROUND_UP (delta * PIT_HZ, 1000000000));
+}
+
+/* Returns true if the thread that A is embedded in should wake
+   before the one B is embedded in. */
+static bool
+wakeup_less (const struct list_elem *a_, const struct list_elem *b_,
+             void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->wakeup_tick < b->wakeup_tick;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -221,7 +418,16 @@ real_time_sleep (int64_t num, int32_t denom)
   int64_t ticks = num * TIMER_FREQ / denom;
 
   ASSERT (intr_get_level () == INTR_ON);
-  if (ticks > 0)
+  if (oneshot_mode && ticks > 0)
+    {
+      /* Block on an hrtimer, which is accurate to well under a
+         tick.  DENOM always divides 10**9.  Shorter waits busy-wait
+         below, since blocking would cost a context switch and a
+         PIT reprogramming for a few microseconds. */
+      ASSERT (1000000000 % denom == 0);
+      hrtimer_sleep (num * (1000000000 / denom));
+    }
+  else if (ticks > 0)
     {
       /* We're waiting for at least one full timer tick.  Use
          timer_sleep() because it will yield the CPU to other
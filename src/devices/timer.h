@@ -7,6 +7,9 @@
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* Nanoseconds per timer tick. */
+#define TIMER_TICK_NS (1000000000 / TIMER_FREQ)
+
 void timer_init (void);
 void timer_calibrate (void);
 
@@ -24,6 +27,11 @@ void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
+/* Tickless idle. */
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+void timer_reprogram (void);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
@@ -0,0 +1,483 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "devices/timer.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* A cached copy of one file system sector.
+
+   An entry is "pinned" while some thread is using it, which
+   keeps it from being evicted.  PIN_CNT and the identity of the
+   entry (SECTOR, VALID, EVICTING, OLD_SECTOR) are protected by
+   cache_lock; the sector contents and DIRTY are protected by the
+   entry's own LOCK, which is only ever acquired by a thread
+   holding a pin.
+
+   An entry that is being reused for another sector while its old
+   contents are written back already caches SECTOR, but until the
+   write is done, EVICTING is true and nobody may read OLD_SECTOR
+   from disk. */
+struct cache_entry
+  {
+    block_sector_t sector;      /* Sector cached here. */
+    bool valid;                 /* True if SECTOR and DATA are meaningful. */
+    bool evicting;              /* Writing back OLD_SECTOR? */
+    block_sector_t old_sector;  /* Sector being written back. */
+    bool dirty;                 /* True if DATA differs from disk. */
+    bool accessed;              /* Second-chance bit for clock eviction. */
+    int pin_cnt;                /* Number of threads using this entry. */
+    struct lock lock;           /* Protects DATA and DIRTY. */
+    uint8_t *data;              /* BLOCK_SECTOR_SIZE bytes of sector data. */
+  };
+
+/* Number of pages backing the cached sector data. */
+#define CACHE_PAGES DIV_ROUND_UP (CACHE_SIZE * BLOCK_SECTOR_SIZE, PGSIZE)
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;  /* Protects entry identity and pins. */
+static struct condition cache_changed;  /* An entry was unpinned or
+                                           finished writing back. */
+static size_t clock_hand;       /* Next eviction candidate. */
+
+/* Sectors waiting to be brought in by the read-ahead thread.
+   A circular queue protected by ra_lock. */
+#define READ_AHEAD_QUEUE 32
+
+/* Most dirty sectors cache_flush() has in flight at once. */
+#define FLUSH_BATCH 8
+
+/* Most queued sectors the read-ahead thread reads at once.  Its
+   bounce buffer is one page. */
+#define READ_AHEAD_RUN (PGSIZE / BLOCK_SECTOR_SIZE)
+static block_sector_t ra_queue[READ_AHEAD_QUEUE];
+static size_t ra_head;          /* Index of oldest queued sector. */
+static size_t ra_cnt;           /* Number of queued sectors. */
+static struct lock ra_lock;
+static struct condition ra_nonempty;
+
+/* See cache.h. */
+unsigned cache_write_behind_ms = 1000;
+
+static struct cache_entry *cache_get (block_sector_t, bool load);
+static struct cache_entry *cache_claim (block_sector_t, bool only_new,
+                                        bool *claimed);
+static void cache_put (struct cache_entry *);
+static struct cache_entry *lookup (block_sector_t);
+static thread_func read_ahead_daemon NO_RETURN;
+static thread_func write_behind_daemon NO_RETURN;
+
+/* Initializes the buffer cache. */
+void
+cache_init (void)
+{
+  uint8_t *pages = palloc_get_multiple (PAL_ASSERT, CACHE_PAGES);
+  size_t i;
+
+  lock_init (&cache_lock);
+  cond_init (&cache_changed);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      e->valid = false;
+      e->evicting = false;
+      e->dirty = false;
+      e->accessed = false;
+      e->pin_cnt = 0;
+      lock_init (&e->lock);
+      e->data = pages + i * BLOCK_SECTOR_SIZE;
+    }
+  clock_hand = 0;
+
+  lock_init (&ra_lock);
+  cond_init (&ra_nonempty);
+  ra_head = ra_cnt = 0;
+  thread_create ("read-ahead", PRI_DEFAULT, read_ahead_daemon, NULL);
+  if (cache_write_behind_ms > 0)
+    thread_create ("write-behind", PRI_DEFAULT, write_behind_daemon, NULL);
+}
+
+/* Reads sector SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, BLOCK_SECTOR_SIZE, 0);
+}
+
+/* Reads SIZE bytes starting at byte OFFSET within sector SECTOR
+   into BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, off_t size, off_t offset)
+{
+  struct cache_entry *e;
+
+  ASSERT (offset >= 0 && size >= 0 && offset + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, true);
+  memcpy (buffer, e->data + offset, size);
+  cache_put (e);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER into sector
+   SECTOR.  The data reaches the disk when the sector is evicted
+   or the cache is flushed. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  cache_write_at (sector, buffer, BLOCK_SECTOR_SIZE, 0);
+}
+
+/* Writes SIZE bytes from BUFFER into sector SECTOR starting at
+   byte OFFSET.  If the write covers only part of the sector, the
+   rest of the sector is read from disk first if it is not
+   already cached. */
+void
+cache_write_at (block_sector_t sector, const void *buffer,
+                off_t size, off_t offset)
+{
+  struct cache_entry *e;
+  bool whole = offset == 0 && size == BLOCK_SECTOR_SIZE;
+
+  ASSERT (offset >= 0 && size >= 0 && offset + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, !whole);
+  memcpy (e->data + offset, buffer, size);
+  e->dirty = true;
+  cache_put (e);
+}
+
+/* Writes every dirty cached sector back to disk.  Up to
+   FLUSH_BATCH writes are submitted at a time, so that the disk's
+   request queue can order and merge them. */
+void
+cache_flush (void)
+{
+  struct cache_entry *batch[FLUSH_BATCH];
+  struct block_request req[FLUSH_BATCH];
+  size_t i = 0;
+
+  while (i < CACHE_SIZE)
+    {
+      size_t n, j;
+
+      for (n = 0; i < CACHE_SIZE && n < FLUSH_BATCH; i++)
+        {
+          struct cache_entry *e = &cache[i];
+
+          lock_acquire (&cache_lock);
+          if (!e->valid || !e->dirty)
+            {
+              lock_release (&cache_lock);
+              continue;
+            }
+          e->pin_cnt++;
+          lock_release (&cache_lock);
+
+          /* Waiting for an entry's lock while holding others could
+             deadlock, so leave a busy entry for the next batch. */
+          if (n == 0)
+            lock_acquire (&e->lock);
+          else if (!lock_try_acquire (&e->lock))
+            {
+              lock_acquire (&cache_lock);
+              e->pin_cnt--;
+              lock_release (&cache_lock);
+              break;
+            }
+
+          if (!e->dirty)
+            {
+              cache_put (e);
+              continue;
+            }
+          block_request_init (&req[n], e->sector, 1, e->data, true,
+                              NULL, NULL);
+          block_submit (fs_device, &req[n]);
+          batch[n++] = e;
+        }
+
+      for (j = 0; j < n; j++)
+        {
+          block_wait (&req[j]);
+          batch[j]->dirty = false;
+          cache_put (batch[j]);
+        }
+    }
+}
+
+/* Asks the read-ahead thread to bring SECTOR into the cache in
+   the background.  Returns immediately.  The request is dropped
+   if SECTOR is already queued or the queue is full. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  size_t i;
+
+  lock_acquire (&ra_lock);
+  for (i = 0; i < ra_cnt; i++)
+    if (ra_queue[(ra_head + i) % READ_AHEAD_QUEUE] == sector)
+      break;
+  if (i == ra_cnt && ra_cnt < READ_AHEAD_QUEUE)
+    {
+      ra_queue[(ra_head + ra_cnt) % READ_AHEAD_QUEUE] = sector;
+      ra_cnt++;
+      cond_signal (&ra_nonempty, &ra_lock);
+    }
+  lock_release (&ra_lock);
+}
+
+/* Loads the CNT entries in RUN, which cache consecutive sectors
+   and were claimed by cache_claim(), with a single multi-sector
+   read into BUF, then releases them. */
+static void
+load_run (struct cache_entry **run, size_t cnt, uint8_t *buf)
+{
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  block_read_multiple (fs_device, run[0]->sector, cnt, buf);
+  for (i = 0; i < cnt; i++)
+    {
+      memcpy (run[i]->data, buf + i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE);
+      cache_put (run[i]);
+    }
+}
+
+/* Read-ahead thread.  Loads queued sectors into the cache, in
+   the order they were requested, so that the thread that asked
+   for them finds them there instead of waiting on the disk.
+   Queued sectors that are consecutive on disk, as a file's
+   sectors usually are, are read with a single disk command. */
+static void
+read_ahead_daemon (void *aux UNUSED)
+{
+  uint8_t *buf = palloc_get_page (PAL_ASSERT);
+  struct cache_entry *run[READ_AHEAD_RUN];
+
+  for (;;)
+    {
+      block_sector_t sectors[READ_AHEAD_RUN];
+      size_t sector_cnt, run_cnt, i;
+
+      /* Take the first queued sector and any that directly
+         follow it on disk. */
+      lock_acquire (&ra_lock);
+      while (ra_cnt == 0)
+        cond_wait (&ra_nonempty, &ra_lock);
+      sector_cnt = 0;
+      do
+        {
+          sectors[sector_cnt++] = ra_queue[ra_head];
+          ra_head = (ra_head + 1) % READ_AHEAD_QUEUE;
+          ra_cnt--;
+        }
+      while (ra_cnt > 0 && sector_cnt < READ_AHEAD_RUN
+             && ra_queue[ra_head] == sectors[sector_cnt - 1] + 1);
+      lock_release (&ra_lock);
+
+      /* Claim entries for the sectors that are not cached yet,
+         reading each unbroken run of them at once. */
+      run_cnt = 0;
+      for (i = 0; i < sector_cnt; i++)
+        {
+          bool claimed;
+          struct cache_entry *e = cache_claim (sectors[i], true, &claimed);
+          if (claimed)
+            run[run_cnt++] = e;
+          else
+            {
+              load_run (run, run_cnt, buf);
+              run_cnt = 0;
+            }
+        }
+      load_run (run, run_cnt, buf);
+    }
+}
+
+/* Write-behind thread.  Periodically writes dirty sectors back
+   to disk, so that a burst of small writes to the same sector
+   turns into a single disk write and little is lost on a crash. */
+static void
+write_behind_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (DIV_ROUND_UP ((int64_t) cache_write_behind_ms * TIMER_FREQ,
+                                 1000));
+      cache_flush ();
+    }
+}
+
+/* Returns true if SECTOR's old contents are still being written
+   back from an entry that has been reused for another sector.
+   The caller must hold cache_lock. */
+static bool
+writing_back (block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].evicting && cache[i].old_sector == sector)
+      return true;
+  return false;
+}
+
+/* Returns the entry caching SECTOR, or a null pointer if SECTOR
+   is not cached.  The caller must hold cache_lock. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Chooses an unpinned entry to reuse, giving each recently
+   accessed entry a second chance.  Returns a null pointer if
+   every entry is pinned.  The caller must hold cache_lock. */
+static struct cache_entry *
+choose_victim (void)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (e->pin_cnt > 0)
+        continue;
+      if (!e->valid)
+        return e;
+      if (e->accessed)
+        e->accessed = false;
+      else
+        return e;
+    }
+  return NULL;
+}
+
+/* Pins and locks the entry for SECTOR, bringing it into the
+   cache if necessary.  If LOAD is false and the sector is not
+   cached, its old contents are not read from disk because the
+   caller intends to overwrite all of them.  The caller must
+   release the entry with cache_put(). */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool load)
+{
+  bool claimed;
+  struct cache_entry *e = cache_claim (sector, false, &claimed);
+
+  if (claimed && load)
+    block_read (fs_device, sector, e->data);
+  return e;
+}
+
+/* Pins and locks the entry for SECTOR.  If SECTOR is already
+   cached, sets *CLAIMED to false and returns its entry, or a
+   null pointer if ONLY_NEW is true.  (A thread that already has
+   entries locked must pass true, since waiting for another
+   entry's lock could deadlock.)  Otherwise, reuses an entry for
+   SECTOR without reading SECTOR's contents, which the caller
+   must fill in before releasing it, and sets *CLAIMED to true.
+   The caller must release the entry with cache_put(). */
+static struct cache_entry *
+cache_claim (block_sector_t sector, bool only_new, bool *claimed)
+{
+  struct cache_entry *e;
+  bool write_back;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      e = lookup (sector);
+      if (e == NULL && writing_back (sector))
+        {
+          /* Reading SECTOR now could see its stale contents on
+             disk.  Wait for the write to finish. */
+          if (only_new)
+            {
+              lock_release (&cache_lock);
+              *claimed = false;
+              return NULL;
+            }
+          cond_wait (&cache_changed, &cache_lock);
+          continue;
+        }
+      if (e != NULL && only_new)
+        {
+          lock_release (&cache_lock);
+          *claimed = false;
+          return NULL;
+        }
+      if (e != NULL)
+        {
+          e->pin_cnt++;
+          e->accessed = true;
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          *claimed = false;
+          return e;
+        }
+
+      e = choose_victim ();
+      if (e != NULL)
+        break;
+
+      /* Every entry is in use.  Wait for one to be released. */
+      cond_wait (&cache_changed, &cache_lock);
+    }
+
+  /* An unpinned entry's lock is never held, so this cannot
+     block.  The entry caches SECTOR from now on, so other users
+     of SECTOR pin it and wait for its lock; the old contents are
+     written back without holding cache_lock. */
+  lock_acquire (&e->lock);
+  write_back = e->valid && e->dirty;
+  if (write_back)
+    {
+      e->evicting = true;
+      e->old_sector = e->sector;
+    }
+  e->sector = sector;
+  e->valid = true;
+  e->dirty = false;
+  e->accessed = true;
+  e->pin_cnt = 1;
+  lock_release (&cache_lock);
+
+  if (write_back)
+    {
+      block_write (fs_device, e->old_sector, e->data);
+      lock_acquire (&cache_lock);
+      e->evicting = false;
+      cond_broadcast (&cache_changed, &cache_lock);
+      lock_release (&cache_lock);
+    }
+  *claimed = true;
+  return e;
+}
+
+/* Unlocks and unpins entry E. */
+static void
+cache_put (struct cache_entry *e)
+{
+  lock_release (&e->lock);
+  lock_acquire (&cache_lock);
+  ASSERT (e->pin_cnt > 0);
+  if (--e->pin_cnt == 0)
+    cond_broadcast (&cache_changed, &cache_lock);
+  lock_release (&cache_lock);
+}
@@ -0,0 +1,23 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+/* Number of sectors held in the buffer cache. */
+#define CACHE_SIZE 64
+
+/* Milliseconds between write-behind flushes of dirty sectors,
+   or 0 to write dirty sectors only on eviction and shutdown.
+   Controlled by kernel command-line option "-wb". */
+extern unsigned cache_write_behind_ms;
+
+void cache_init (void);
+void cache_read (block_sector_t, void *);
+void cache_read_at (block_sector_t, void *, off_t size, off_t offset);
+void cache_write (block_sector_t, const void *);
+void cache_write_at (block_sector_t, const void *, off_t size, off_t offset);
+void cache_flush (void);
+void cache_read_ahead (block_sector_t);
+
+#endif /* filesys/cache.h */
@@ -0,0 +1,174 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* The dentry cache remembers the result of looking up a name in
+   a directory, so that resolving the same path again does not
+   read the directory.  A "negative" entry records that the name
+   was not there.
+
+   Entries are keyed by the sector of the directory's inode and
+   the name.  The directory code keeps them correct by calling
+   dcache_invalidate() whenever it adds or removes a name, while
+   holding the directory's dir lock, and by only inserting the
+   result of a lookup made under that same lock. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in dentries. */
+    struct list_elem lru_elem;          /* Element in lru. */
+    block_sector_t parent;              /* Sector of directory inode. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    bool found;                         /* False for a negative entry. */
+    block_sector_t child;               /* Sector of NAME's inode. */
+  };
+
+static struct hash dentries;    /* All entries, by parent and name. */
+static struct list lru;         /* All entries, most recently used first. */
+static size_t dentry_cnt;       /* Number of entries. */
+static struct lock dcache_lock; /* Protects all of the above. */
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+static struct dentry *find (block_sector_t parent, const char *name);
+
+/* Initializes the dentry cache. */
+void
+dcache_init (void)
+{
+  hash_init (&dentries, dentry_hash, dentry_less, NULL);
+  list_init (&lru);
+  dentry_cnt = 0;
+  lock_init (&dcache_lock);
+}
+
+/* Looks up NAME in the directory whose inode is in sector PARENT.
+   Returns false if the answer is not cached.  Otherwise, returns
+   true and sets *FOUND to whether NAME exists and, if it does,
+   *CHILD to the sector of its inode. */
+bool
+dcache_lookup (block_sector_t parent, const char *name,
+               bool *found, block_sector_t *child)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (parent, name);
+  if (d != NULL)
+    {
+      list_remove (&d->lru_elem);
+      list_push_front (&lru, &d->lru_elem);
+      *found = d->found;
+      *child = d->child;
+    }
+  lock_release (&dcache_lock);
+  return d != NULL;
+}
+
+/* Records that NAME in the directory whose inode is in sector
+   PARENT has its inode in sector CHILD if FOUND is true, or does
+   not exist if FOUND is false.  Evicts the least recently used
+   entry if the cache is full.  Names too long to exist are not
+   recorded. */
+void
+dcache_insert (block_sector_t parent, const char *name,
+               bool found, block_sector_t child)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = find (parent, name);
+  if (d == NULL)
+    {
+      if (dentry_cnt < DCACHE_SIZE)
+        d = malloc (sizeof *d);
+      if (d != NULL)
+        dentry_cnt++;
+      else if (!list_empty (&lru))
+        {
+          /* Reuse the least recently used entry. */
+          d = list_entry (list_back (&lru), struct dentry, lru_elem);
+          hash_delete (&dentries, &d->hash_elem);
+          list_remove (&d->lru_elem);
+        }
+      else
+        {
+          lock_release (&dcache_lock);
+          return;
+        }
+      d->parent = parent;
+      strlcpy (d->name, name, sizeof d->name);
+      hash_insert (&dentries, &d->hash_elem);
+    }
+  else
+    list_remove (&d->lru_elem);
+  list_push_front (&lru, &d->lru_elem);
+  d->found = found;
+  d->child = child;
+  lock_release (&dcache_lock);
+}
+
+/* Forgets anything cached about NAME in the directory whose
+   inode is in sector PARENT. */
+void
+dcache_invalidate (block_sector_t parent, const char *name)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (parent, name);
+  if (d != NULL)
+    {
+      hash_delete (&dentries, &d->hash_elem);
+      list_remove (&d->lru_elem);
+      dentry_cnt--;
+      free (d);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Returns the entry for NAME in PARENT, or a null pointer if
+   there is none.  The caller must hold dcache_lock. */
+static struct dentry *
+find (block_sector_t parent, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&dcache_lock));
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.parent = parent;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Returns a hash value for the dentry that E is embedded in. */
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->parent);
+}
+
+/* Returns true if the dentry that A is embedded in sorts before
+   the one B is embedded in. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->parent != b->parent)
+    return a->parent < b->parent;
+  return strcmp (a->name, b->name) < 0;
+}
@@ -0,0 +1,17 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Maximum number of names remembered by the dentry cache. */
+#define DCACHE_SIZE 256
+
+void dcache_init (void);
+bool dcache_lookup (block_sector_t parent, const char *name,
+                    bool *found, block_sector_t *child);
+void dcache_insert (block_sector_t parent, const char *name,
+                    bool found, block_sector_t child);
+void dcache_invalidate (block_sector_t parent, const char *name);
+
+#endif /* filesys/dcache.h */
@@ -1,7 +1,9 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "filesys/file.h"
@@ -26,6 +28,29 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* In-memory index of the entries of one directory, built the
+   first time the directory is searched and kept until its inode
+   is closed for the last time.  Finds a name, or a free slot for
+   a new one, without reading the whole directory.  Protected by
+   the directory inode's dir lock. */
+struct dir_index
+  {
+    struct hash names;            /* Entries in use, by name. */
+    off_t *free_slots;            /* Offsets of unused entries. */
+    size_t free_cnt;              /* Number of FREE_SLOTS in use. */
+    size_t free_cap;              /* Number of FREE_SLOTS allocated. */
+    off_t end;                    /* Offset just past the last entry. */
+  };
+
+/* An entry in use, as recorded in a dir_index. */
+struct index_entry
+  {
+    struct hash_elem elem;              /* Element in dir_index names. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    block_sector_t inode_sector;        /* Sector number of header. */
+    off_t ofs;                          /* Byte offset in directory. */
+  };
+
 static struct dir root_dir;
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
@@ -102,21 +127,177 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Returns a hash value for the index_entry that E is embedded in. */
+static unsigned
+index_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_string (hash_entry (e, struct index_entry, elem)->name);
+}
+
+/* Returns true if the name of the index_entry that A is embedded
+   in sorts before the one B is embedded in. */
+static bool
+index_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return strcmp (hash_entry (a, struct index_entry, elem)->name,
+                 hash_entry (b, struct index_entry, elem)->name) < 0;
+}
+
+/* Frees the index_entry that E is embedded in. */
+static void
+index_entry_free (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct index_entry, elem));
+}
+
+/* Frees directory index INDEX.  Called by the inode layer when
+   the directory's inode is closed for the last time. */
+void
+dir_index_destroy (struct dir_index *index)
+{
+  if (index != NULL)
+    {
+      hash_destroy (&index->names, index_entry_free);
+      free (index->free_slots);
+      free (index);
+    }
+}
+
+/* Throws away DIR's index, e.g. because it could not be kept up
+   to date for lack of memory.  It is rebuilt on next use. */
+static void
+index_drop (struct dir *dir)
+{
+  dir_index_destroy (inode_get_dir_index (dir->inode));
+  inode_set_dir_index (dir->inode, NULL);
+}
+
+/* Records that there is a name-to-inode entry for NAME at OFS in
+   INDEX.  Returns false if memory is exhausted. */
+static bool
+index_insert (struct dir_index *index, const char *name,
+              block_sector_t inode_sector, off_t ofs)
+{
+  struct index_entry *ie = malloc (sizeof *ie);
+  if (ie == NULL)
+    return false;
+  strlcpy (ie->name, name, sizeof ie->name);
+  ie->inode_sector = inode_sector;
+  ie->ofs = ofs;
+  hash_insert (&index->names, &ie->elem);
+  return true;
+}
+
+/* Records that the entry at OFS in INDEX is free.  Returns false
+   if memory is exhausted. */
+static bool
+index_push_free (struct dir_index *index, off_t ofs)
+{
+  if (index->free_cnt == index->free_cap)
+    {
+      size_t cap = index->free_cap > 0 ? 2 * index->free_cap : 8;
+      off_t *slots = realloc (index->free_slots, cap * sizeof *slots);
+      if (slots == NULL)
+        return false;
+      index->free_slots = slots;
+      index->free_cap = cap;
+    }
+  index->free_slots[index->free_cnt++] = ofs;
+  return true;
+}
+
+/* Returns DIR's index, reading the whole directory to build it
+   if this is the first time it is needed.  Returns a null pointer
+   if memory is exhausted.  The caller must hold DIR's dir lock. */
+static struct dir_index *
+get_index (const struct dir *dir)
+{
+  struct dir_index *index = inode_get_dir_index (dir->inode);
+  struct dir_entry e;
+  off_t ofs;
+
+  if (index != NULL)
+    return index;
+
+  index = malloc (sizeof *index);
+  if (index == NULL)
+    return NULL;
+  if (!hash_init (&index->names, index_hash, index_less, NULL))
+    {
+      free (index);
+      return NULL;
+    }
+  index->free_slots = NULL;
+  index->free_cnt = index->free_cap = 0;
+
+  /* Walk the entries from the end, so that the lowest free slot
+     ends up on top of the free stack and gets reused first. */
+  index->end = inode_length (dir->inode) / sizeof e * sizeof e;
+  for (ofs = index->end; ofs > 0; )
+    {
+      bool ok;
+      ofs -= sizeof e;
+      if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+        e.in_use = false;
+      if (e.in_use)
+        ok = index_insert (index, e.name, e.inode_sector, ofs);
+      else
+        ok = index_push_free (index, ofs);
+      if (!ok)
+        {
+          dir_index_destroy (index);
+          return NULL;
+        }
+    }
+
+  inode_set_dir_index (dir->inode, index);
+  return index;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   The caller must hold DIR's dir lock. */
 static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp)
 {
+  struct dir_index *index;
   struct dir_entry e;
   size_t ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  index = get_index (dir);
+  if (index != NULL)
+    {
+      struct index_entry key;
+      struct hash_elem *he;
+      struct index_entry *ie;
+
+      if (strlen (name) > NAME_MAX)
+        return false;
+      strlcpy (key.name, name, sizeof key.name);
+      he = hash_find (&index->names, &key.elem);
+      if (he == NULL)
+        return false;
+      ie = hash_entry (he, struct index_entry, elem);
+      if (ep != NULL)
+        {
+          ep->inode_sector = ie->inode_sector;
+          strlcpy (ep->name, ie->name, sizeof ep->name);
+          ep->in_use = true;
+        }
+      if (ofsp != NULL)
+        *ofsp = ie->ofs;
+      return true;
+    }
+
+  /* No index, so fall back to reading every entry. */
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e)
     if (e.in_use && !strcmp (name, e.name))
@@ -146,10 +327,27 @@ dir_lookup (const struct dir *dir, const char *name,
     return dir_get_inode(dir);
   if(strcmp(name,".")==0)
     *inode= dir_get_inode(dir);
-  else if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
   else
-    *inode = NULL;
+    {
+      block_sector_t parent = inode_get_inumber (dir->inode);
+      block_sector_t child;
+      bool found;
+
+      /* Try the dentry cache first, which saves reading the
+         directory.  The entry is only trusted under the dir lock,
+         which keeps a concurrent dir_remove() from freeing CHILD
+         before it is opened. */
+      dir_lock_acquire (dir->inode);
+      if (dcache_lookup (parent, name, &found, &child))
+        *inode = found ? inode_open (child) : NULL;
+      else
+        {
+          found = lookup (dir, name, &e, NULL);
+          dcache_insert (parent, name, found, found ? e.inode_sector : 0);
+          *inode = found ? inode_open (e.inode_sector) : NULL;
+        }
+      dir_lock_release (dir->inode);
+    }
   return *inode != NULL;
 }
 
@@ -163,6 +361,7 @@ bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
   struct dir_entry e;
+  struct dir_index *index;
   off_t ofs;
   bool success = false;
   ASSERT (dir != NULL);
@@ -173,41 +372,54 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
     goto done;
   }
 
+  dir_lock_acquire (dir->inode);
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL)){
-    goto done;
+    goto unlock;
   }
 
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
      current end-of-file.
 
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e)
-    if (!e.in_use)
-      break;
+     The index, if there is one, knows where the free slots are.
+     Otherwise scan for one.  inode_read_at() will only return a
+     short read at end of file.  Otherwise, we'd need to verify
+     that we didn't get a short read due to something intermittent
+     such as low memory. */
+  index = get_index (dir);
+  if (index != NULL)
+    ofs = index->free_cnt > 0 ? index->free_slots[index->free_cnt - 1]
+                              : index->end;
+  else
+    for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+         ofs += sizeof e)
+      if (!e.in_use)
+        break;
 
 
   /* Write slot. */
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  int denied = deny_cnt(dir->inode);
-
-  while(is_denied(dir->inode)){
-    inode_allow_write(dir->inode);
-  }
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-  for(; denied>0; denied--)
-    inode_deny_write(dir->inode);
+  if(success){
+    add_entry(dir_get_inode(dir));
+    dcache_invalidate(inode_get_inumber(dir->inode), name);
+    if(index != NULL){
+      if(index->free_cnt > 0 && index->free_slots[index->free_cnt - 1] == ofs)
+        index->free_cnt--;
+      else
+        index->end = ofs + sizeof e;
+      if(!index_insert(index, name, inode_sector, ofs))
+        index_drop(dir);
+    }
+  }
 
+ unlock:
+  dir_lock_release (dir->inode);
  done:
-  if(success)
-      add_entry(dir_get_inode(dir));
-
   return success;
 }
 
@@ -220,6 +432,7 @@ bool
 dir_remove (struct dir *dir, const char *name)
 {
   struct dir_entry e;
+  struct dir_index *index;
   struct inode *inode = NULL;
   bool success = false;
   off_t ofs;
@@ -227,6 +440,8 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  dir_lock_acquire (dir->inode);
+
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
     goto done;
@@ -242,6 +457,22 @@ dir_remove (struct dir *dir, const char *name)
     goto done;
 
 
+  /* Drop the entry from the index and the dentry cache too. */
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  index = inode_get_dir_index (dir->inode);
+  if (index != NULL)
+    {
+      struct index_entry key;
+      struct hash_elem *he;
+
+      strlcpy (key.name, name, sizeof key.name);
+      he = hash_delete (&index->names, &key.elem);
+      if (he != NULL)
+        free (hash_entry (he, struct index_entry, elem));
+      if (!index_push_free (index, ofs))
+        index_drop (dir);
+    }
+
   /* Remove inode. */
   inode_remove (inode);
   success = true;
@@ -250,6 +481,7 @@ dir_remove (struct dir *dir, const char *name)
   inode_close (inode);
   if(success)
     remove_entry(dir_get_inode(dir));
+  dir_lock_release (dir->inode);
   return success;
 }
 
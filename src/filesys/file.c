@@ -52,8 +52,7 @@ file_close (struct file *file)
 {
   if (file != NULL)
     {
-      if(is_denied(file->inode))
-        file_allow_write (file);
+      file_allow_write (file);
       inode_close (file->inode);
       free (file);
     }
@@ -2,6 +2,8 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
@@ -26,6 +28,8 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
+  dcache_init ();
   inode_init ();
   free_map_init ();
 
@@ -41,6 +45,7 @@ void
 filesys_done (void)
 {
   free_map_close ();
+  cache_flush ();
 }
 
 
@@ -68,7 +73,6 @@ filesys_create (const char *name, off_t initial_size)
   // Anthony done
 
   //Allocate resources for file and add
-  lock_acquire(&create_lock);
   bool allocate = free_map_allocate(1, &inode_sector);
   bool inode_c = inode_create(inode_sector, initial_size);
   bool added = dir_add(dir, fetch_filename(name), inode_sector);
@@ -78,7 +82,6 @@ filesys_create (const char *name, off_t initial_size)
                   && added);
   if (!success && inode_sector != 0)
     free_map_release (inode_sector, 1);
-  lock_release(&create_lock);
   
   return success;
 }
@@ -200,20 +203,28 @@ Parameters:
 Return:
 - NULL, if the path leads to no existing directory
 - inode of the second lowest directory in the path
+
+Each component goes through dir_lookup, which answers from the dentry
+cache without reading the directory.  The walk still opens every
+directory on the way: holding it open is what keeps a concurrent
+rmdir from freeing it under us, and a cached sector alone could be
+stale by the time we got to it.  Opening an inode that is already
+open is a hash lookup, so this costs little.
 */
 
 struct inode *
 fetch_from_path (const char* path) {
 
+  //Get filename of file/directory at end of path, only once, since
+  //fetch_filename allocates a copy every time
+  const char* file_name = fetch_filename(path);
   char* name = malloc(strlen( path ) * sizeof(char) + 1 );
-  char* expected_file = malloc( strlen ( fetch_filename ( path ) ) + 1 );
+  char* expected_file = malloc( strlen ( file_name ) + 1 );
 
   struct dir* dir;
   struct inode* inode = NULL;
 
-  //Get filename of file/directory at end of path
-  strlcpy(expected_file,fetch_filename(path),
-    strlen(fetch_filename(path)) + 1);
+  strlcpy(expected_file, file_name, strlen(file_name) + 1);
 
   //Determine path leading up to end file/directory
   strlcpy(name, path, strlen(path) - strlen(expected_file) + 1);
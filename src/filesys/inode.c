@@ -1,14 +1,16 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/directory.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
 #include "devices/block.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
-#include "userprog/syscall.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -16,6 +18,24 @@
 #define SINGLE_BLOCKS 128
 #define DOUBLE_BLOCKS 128
 #define MAX_FILE_SIZE 16384
+#define READ_AHEAD_MAX 8       /* Largest read-ahead window, in sectors. */
+#define EXTENT_CNT 62          /* Extents that fit in an on-disk inode. */
+#define EXTENT_SLACK_MAX 128   /* Most sectors reserved past EOF. */
+
+/* Ways an inode_disk can record where its data lives. */
+#define LAYOUT_INDEXED 0       /* Direct, single and double indirect. */
+#define LAYOUT_EXTENTS 1       /* Runs of contiguous sectors. */
+
+/* See inode.h. */
+bool inode_extents;
+
+/* A run of LENGTH contiguous sectors starting at START.
+   Unused extents have LENGTH 0. */
+struct inode_extent
+  {
+    block_sector_t start;
+    block_sector_t length;
+  };
 
 
 /* On-disk inode.
@@ -24,14 +44,27 @@ struct inode_disk
   {
     off_t length;                         				/* File size in bytes. */
     bool is_directory;
+    uint8_t layout;                               /* LAYOUT_INDEXED or
+                                                     LAYOUT_EXTENTS. */
     int entry_cnt;                                /* Number of entries in 
                                                      directory */
     unsigned magic;                       				/* Magic number. */
-    block_sector_t direct_blocks[DIRECT_BLOCKS];	/*first 122 direct blocks*/
-    block_sector_t singleIB;              				/*Sector location of single 
-                                                    indirection block */
-    block_sector_t doubleIB;              				/*Sector location of double 
-                                                    indirection block */
+    union
+      {
+        /* LAYOUT_INDEXED. */
+        struct
+          {
+            block_sector_t direct_blocks[DIRECT_BLOCKS];	/*first 122 direct
+                                                              blocks*/
+            block_sector_t singleIB;      /*Sector location of single 
+                                            indirection block */
+            block_sector_t doubleIB;      /*Sector location of double 
+                                            indirection block */
+          };
+
+        /* LAYOUT_EXTENTS. */
+        struct inode_extent extents[EXTENT_CNT];
+      };
   };
 
 /*On disk single Indirect block, 
@@ -61,65 +94,295 @@ bytes_to_sectors (off_t size)
 /* In-memory inode. */
 struct inode
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
+    bool busy;                          /* Being read in or torn down? */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct inode_disk data;             /* Inode content. */
     struct lock remove_lock;            /* lock for removal synchronization*/
+    struct lock dir_lock;               /* Serializes directory updates. */
+    struct dir_index *dir_index;        /* Name index, if a directory. */
+    struct rwlock rw;                   /* Readers share, extenders exclude. */
+    struct lock index_lock;             /* Protects the index blocks below. */
+    struct singleIB *single;            /* Pinned single indirect block. */
+    struct doubleIB *doubly;            /* Pinned double indirect block. */
+    struct singleIB *double_single;     /* Last used block under DOUBLY. */
+    int double_single_idx;              /* Index of DOUBLE_SINGLE in DOUBLY,
+                                           or -1. */
+    struct lock ra_lock;                /* Protects the read-ahead state. */
+    off_t ra_next;                      /* Where a sequential read resumes. */
+    off_t ra_end;                       /* End of region queued for
+                                           read-ahead. */
+    int ra_window;                      /* Read-ahead window in sectors. */
 	  
   };
 
+/* Returns the number of data sectors allocated to extent-based
+   inode D. */
+static size_t
+extent_sectors (const struct inode_disk *d)
+{
+  size_t cnt = 0;
+  int i;
+
+  for (i = 0; i < EXTENT_CNT && d->extents[i].length > 0; i++)
+    cnt += d->extents[i].length;
+  return cnt;
+}
+
+/* Returns the disk sector holding data sector IDX of
+   extent-based inode D, or -1 if D has no such sector. */
+static block_sector_t
+extent_to_sector (const struct inode_disk *d, size_t idx)
+{
+  int i;
+
+  for (i = 0; i < EXTENT_CNT && d->extents[i].length > 0; i++)
+    {
+      if (idx < d->extents[i].length)
+        return d->extents[i].start + idx;
+      idx -= d->extents[i].length;
+    }
+  return -1;
+}
+
+/* Zeros the CNT sectors starting at SECTOR. */
+static void
+zero_sectors (block_sector_t sector, size_t cnt)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  while (cnt-- > 0)
+    cache_write (sector++, zeros);
+}
+
+/* Zeros data sectors FROM up to TO of extent-based inode D. */
+static void
+extent_zero (const struct inode_disk *d, size_t from, size_t to)
+{
+  for (; from < to; from++)
+    zero_sectors (extent_to_sector (d, from), 1);
+}
+
+/* Adds at least CNT data sectors to the end of extent-based
+   inode D.  Grows the last extent in place when the
+   sectors after it are free, and otherwise starts a new extent at
+   the largest contiguous free run it can find, down to a single
+   sector.  A new extent also reserves slack past CNT, as many
+   sectors as D already has up to EXTENT_SLACK_MAX, so that files
+   growing a sector at a time side by side still get long runs
+   instead of filling the extent table; extent_trim() gives the
+   slack back.  The new sectors are not zeroed: the caller zeros
+   those the file comes to cover with extent_zero(), so unused
+   slack costs no writes.  Returns true if successful, false if the disk is
+   full or D has run out of extents, in which case D keeps
+   whatever sectors were added. */
+static bool
+extent_grow (struct inode_disk *d, size_t cnt)
+{
+  size_t have = 0;
+  int i = 0;
+
+  while (i < EXTENT_CNT && d->extents[i].length > 0)
+    have += d->extents[i++].length;
+  while (cnt > 0)
+    {
+      size_t run, slack;
+
+      /* Try to grow the last extent in place. */
+      if (i > 0)
+        {
+          struct inode_extent *last = &d->extents[i - 1];
+          block_sector_t end = last->start + last->length;
+          for (run = cnt; run > 0; run /= 2)
+            if (free_map_allocate_at (end, run))
+              break;
+          if (run > 0)
+            {
+              last->length += run;
+              cnt -= run;
+              continue;
+            }
+        }
+
+      /* Start a new extent. */
+      if (i >= EXTENT_CNT)
+        return false;
+      slack = have < EXTENT_SLACK_MAX ? have : EXTENT_SLACK_MAX;
+      for (run = cnt + slack; run > 0; run /= 2)
+        if (free_map_allocate (run, &d->extents[i].start))
+          break;
+      if (run == 0)
+        return false;
+      d->extents[i].length = run;
+      have += run;
+      cnt -= run < cnt ? run : cnt;
+      i++;
+    }
+  return true;
+}
+
+/* Releases the data sectors of extent-based inode D past the
+   first KEEP, such as the slack reserved by extent_grow().
+   Returns true if D changed. */
+static bool
+extent_trim (struct inode_disk *d, size_t keep)
+{
+  bool changed = false;
+  int i;
+
+  for (i = 0; i < EXTENT_CNT && d->extents[i].length > 0; i++)
+    {
+      struct inode_extent *e = &d->extents[i];
+
+      if (keep >= e->length)
+        keep -= e->length;
+      else
+        {
+          free_map_release (e->start + keep, e->length - keep);
+          e->length = keep;
+          keep = 0;
+          changed = true;
+        }
+    }
+  return changed;
+}
+
+/* Releases every data sector of extent-based inode D. */
+static void
+extent_release (struct inode_disk *d)
+{
+  int i;
+
+  for (i = 0; i < EXTENT_CNT && d->extents[i].length > 0; i++)
+    free_map_release (d->extents[i].start, d->extents[i].length);
+}
+
+/* Returns INODE's single indirect block, reading it into memory
+   the first time it is needed.  The copy stays pinned in INODE
+   until the inode is closed.  INODE's index_lock must be held. */
+static struct singleIB *
+get_single (struct inode *inode)
+{
+  ASSERT (lock_held_by_current_thread (&inode->index_lock));
+  if (inode->single == NULL)
+    {
+      inode->single = malloc (sizeof *inode->single);
+      if (inode->single == NULL)
+        return NULL;
+      cache_read (inode->data.singleIB, inode->single);
+    }
+  return inode->single;
+}
+
+/* Returns INODE's double indirect block, reading it into memory
+   the first time it is needed.  INODE's index_lock must be
+   held. */
+static struct doubleIB *
+get_double (struct inode *inode)
+{
+  ASSERT (lock_held_by_current_thread (&inode->index_lock));
+  if (inode->doubly == NULL)
+    {
+      inode->doubly = malloc (sizeof *inode->doubly);
+      if (inode->doubly == NULL)
+        return NULL;
+      cache_read (inode->data.doubleIB, inode->doubly);
+    }
+  return inode->doubly;
+}
+
+/* Returns the IDXth index block hanging off INODE's double
+   indirect block.  Only the most recently used one is kept in
+   memory, which is all a sequential scan needs.  INODE's
+   index_lock must be held. */
+static struct singleIB *
+get_double_single (struct inode *inode, int idx)
+{
+  struct doubleIB *doubly = get_double (inode);
+
+  ASSERT (lock_held_by_current_thread (&inode->index_lock));
+  if (doubly == NULL)
+    return NULL;
+  if (inode->double_single == NULL)
+    {
+      inode->double_single = malloc (sizeof *inode->double_single);
+      if (inode->double_single == NULL)
+        return NULL;
+      inode->double_single_idx = -1;
+    }
+  if (inode->double_single_idx != idx)
+    {
+      cache_read (doubly->single_blocks[idx], inode->double_single);
+      inode->double_single_idx = idx;
+    }
+  return inode->double_single;
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos)
+byte_to_sector (struct inode *inode, off_t pos)
 {
   ASSERT (inode != NULL);
   block_sector_t val;
   val = -1;
   if (pos < inode->data.length){
+    int num_sectors = pos / BLOCK_SECTOR_SIZE;
+    if(inode->data.layout == LAYOUT_EXTENTS)
+      return extent_to_sector(&inode->data, num_sectors);
     //pos is within the first 122 direct blocks
-	  if(pos < DIRECT_BLOCKS * BLOCK_SECTOR_SIZE){
-      val = inode->data.direct_blocks[pos / BLOCK_SECTOR_SIZE];
+	  if(num_sectors < DIRECT_BLOCKS){
+      return inode->data.direct_blocks[num_sectors];
 	  }
+    lock_acquire(&inode->index_lock);
     //pos is within the blocks pointed to by the Single Indirect block
-	  else if(pos <= (DIRECT_BLOCKS + SINGLE_BLOCKS) * BLOCK_SECTOR_SIZE){
-	  	struct singleIB *single = malloc(sizeof(struct singleIB));
-	  	block_read(fs_device, inode->data.singleIB, single);
-	  	val = single->data_blocks[pos/BLOCK_SECTOR_SIZE - DIRECT_BLOCKS];
-      free(single);
+	  if(num_sectors < DIRECT_BLOCKS + SINGLE_BLOCKS){
+	  	struct singleIB *single = get_single(inode);
+      if(single != NULL)
+	  	  val = single->data_blocks[num_sectors - DIRECT_BLOCKS];
 	  }
     //pos is within the double indirect blocks
-	  else if(pos <= MAX_FILE_SIZE * BLOCK_SECTOR_SIZE){
-	  	struct doubleIB *doubly = malloc(sizeof(struct doubleIB));
-    	block_read(fs_device, inode->data.doubleIB, doubly);
-    	struct singleIB *single = malloc(sizeof(struct singleIB));
-      int num_sectors = pos / BLOCK_SECTOR_SIZE;
+	  else if(num_sectors < MAX_FILE_SIZE){
       int double_block = num_sectors - (DIRECT_BLOCKS + SINGLE_BLOCKS);
-    	int singleNum = (double_block) / DOUBLE_BLOCKS;
-    	block_read(fs_device, doubly->single_blocks[singleNum], single);
-    	val = single->data_blocks[(double_block) % DOUBLE_BLOCKS];
-      free(doubly);
-      free(single);
+    	struct singleIB *single = get_double_single(inode,
+                                          double_block / DOUBLE_BLOCKS);
+      if(single != NULL)
+    	  val = single->data_blocks[double_block % DOUBLE_BLOCKS];
 	  }
-
+    lock_release(&inode->index_lock);
   }
   return val;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Table of open inodes, keyed by sector, so that opening a
+   single inode twice returns the same `struct inode'.
+   open_inodes_lock protects the table and every inode's
+   open_cnt, deny_write_cnt and busy flag.
+
+   Disk I/O is done without the lock.  An inode being read in by
+   its first opener, or written back by its last closer, stays in
+   the table marked busy, and anyone else opening its sector
+   waits on open_inodes_cond until it is ready or gone. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+static struct condition open_inodes_cond;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
 
 /* Initializes the inode module. */
 void
 inode_init (void)
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("can't allocate open inode table");
+  lock_init (&open_inodes_lock);
+  cond_init (&open_inodes_cond);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -147,6 +410,21 @@ inode_create (block_sector_t sector, off_t length)
   disk_inode->is_directory=false;
   disk_inode->length = length;
   disk_inode->magic = INODE_MAGIC;
+
+  //Extent layout: grab the data in as few contiguous runs as possible
+  if(inode_extents){
+    disk_inode->layout = LAYOUT_EXTENTS;
+    success = extent_grow(disk_inode, bytes_to_sectors(length));
+    if(success){
+      extent_zero(disk_inode, 0, bytes_to_sectors(length));
+      cache_write(sector, disk_inode);
+    }
+    else
+      extent_release(disk_inode);
+    free(disk_inode);
+    return success;
+  }
+  disk_inode->layout = LAYOUT_INDEXED;
  
   //Allocates the direct blocks
   for(i = 0; i < DIRECT_BLOCKS; i++){
@@ -174,11 +452,11 @@ inode_create (block_sector_t sector, off_t length)
   	disk_inode->singleIB = location;
   if(free_map_allocate(1, &location))
   	disk_inode->doubleIB = location;
-  block_write (fs_device, sector, disk_inode);
+  cache_write (sector, disk_inode);
   static char zeros[BLOCK_SECTOR_SIZE];
   //Writes zeros to the spaces allocated for direct blocks
   for(i = 0; i < currLength/BLOCK_SECTOR_SIZE; i++){
-  	block_write(fs_device, disk_inode->direct_blocks[i], zeros);
+  	cache_write(disk_inode->direct_blocks[i], zeros);
   }
   //If we have reached the files needed size, return
   if(success){
@@ -196,17 +474,19 @@ inode_create (block_sector_t sector, off_t length)
   		else if(free_map_allocate(1, &location)){
            singly->data_blocks[i] = location;
            currLength += BLOCK_SECTOR_SIZE;
-           block_write(fs_device, location, zeros);
+           cache_write(location, zeros);
   		}
-      //not enough room pm disk for file, free the allocated sectors
+      //not enough room pm disk for file, free the allocated sectors.
+      //inode_create_failure() finds them through the index block
   		else{
+  			cache_write(disk_inode->singleIB, singly);
   			inode_create_failure(disk_inode, currLength);
         free(singly);
   			return false;
   		}   
   }
   //write singleIB to disk
-  block_write(fs_device, disk_inode->singleIB, singly);
+  cache_write(disk_inode->singleIB, singly);
   free(singly);
 
   if(success){
@@ -214,16 +494,18 @@ inode_create (block_sector_t sector, off_t length)
   }
   struct doubleIB *doubly = malloc(sizeof(struct doubleIB));
   //Build the doubleIB struct and allocate its single Index Blocks
-  //and the blocks those point to.
-  for(i = 0; i < DOUBLE_BLOCKS; i++){
+  //and the blocks those point to.  Stop at the last block in use, so
+  //that allocate_sector() creates the next single Index Block itself.
+  for(i = 0; i < DOUBLE_BLOCKS && currLength < length; i++){
   	size_t j;
   	struct singleIB *doubly_singly = malloc(sizeof(struct singleIB));  
-  	if(!free_map_allocate(1, &location) && !success){
+  	if(!free_map_allocate(1, &location)){
+  	 	cache_write(disk_inode->doubleIB, doubly);
   	 	inode_create_failure(disk_inode, currLength);
+  	 	free(doubly_singly);
+  	 	free(doubly);
   	 	return false;
   	}
-  	else if(success)
-  	  break;
   	doubly->single_blocks[i] = location;
     //Builds each singleIB struct and allocates its data on disk
   	for(j = 0; j < SINGLE_BLOCKS; j++){  
@@ -231,19 +513,24 @@ inode_create (block_sector_t sector, off_t length)
   		  success = true;
   		}
   		else if(free_map_allocate(1, &location)){
-        doubly_singly->data_blocks[i] = location;
+        doubly_singly->data_blocks[j] = location;
         currLength += BLOCK_SECTOR_SIZE;
-        block_write(fs_device, location, zeros);
+        cache_write(location, zeros);
   		}
   		else{
+  			cache_write(doubly->single_blocks[i], doubly_singly);
+  			cache_write(disk_inode->doubleIB, doubly);
   			inode_create_failure(disk_inode, currLength);
+  			free(doubly_singly);
+  			free(doubly);
   			return false;
   		}   
   	}
-  	block_write(fs_device, doubly->single_blocks[i], doubly_singly);
+  	cache_write(doubly->single_blocks[i], doubly_singly);
     free(doubly_singly);
   }
-  block_write(fs_device, disk_inode->doubleIB, doubly);
+  success = currLength >= length;
+  cache_write(disk_inode->doubleIB, doubly);
   free(doubly);
   free(disk_inode);
   return success;
@@ -255,35 +542,61 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
+
+  lock_acquire (&open_inodes_lock);
+
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e))
+  key.sector = sector;
+  while ((e = hash_find (&open_inodes, &key.elem)) != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector)
+      inode = hash_entry (e, struct inode, elem);
+      if (!inode->busy)
         {
-          inode_reopen (inode);
+          inode->open_cnt++;
+          lock_release (&open_inodes_lock);
           return inode;
         }
+      cond_wait (&open_inodes_cond, &open_inodes_lock);
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL){
+    lock_release (&open_inodes_lock);
     return NULL;
-
   }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize.  The inode is published busy, so that other
+     openers wait for it to be read in. */
   inode->sector = sector;
   inode->open_cnt = 1;
+  inode->busy = true;
   inode->deny_write_cnt = 0;
   inode->removed = false;
   lock_init(&inode->remove_lock);
-  block_read (fs_device, inode->sector, &inode->data);
+  lock_init(&inode->dir_lock);
+  inode->dir_index = NULL;
+  rwlock_init(&inode->rw);
+  lock_init(&inode->index_lock);
+  inode->single = NULL;
+  inode->doubly = NULL;
+  inode->double_single = NULL;
+  inode->double_single_idx = -1;
+  lock_init(&inode->ra_lock);
+  inode->ra_next = inode->ra_end = 0;
+  inode->ra_window = 1;
+  hash_insert (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+
+  cache_read (inode->sector, &inode->data);
+
+  lock_acquire (&open_inodes_lock);
+  inode->busy = false;
+  cond_broadcast (&open_inodes_cond, &open_inodes_lock);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -292,7 +605,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -313,24 +630,46 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_inodes_lock);
+  if (--inode->open_cnt > 0)
     {
+      lock_release (&open_inodes_lock);
+      return;
+    }
 
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
-
-      /* Deallocate blocks if removed. */
-      if (inode->removed)
-        {
-          //Write inode data back to disk
-          block_write(fs_device, inode->sector, &inode->data);
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.direct_blocks[0],
-                            bytes_to_sectors (inode->data.length));
-        }
+  /* Keep reopeners off it until it is written back. */
+  inode->busy = true;
+  lock_release (&open_inodes_lock);
 
-      free (inode);
+  /* Deallocate blocks if removed. */
+  if (inode->removed)
+    {
+      //Write inode data back to disk
+      cache_write(inode->sector, &inode->data);
+      free_map_release (inode->sector, 1);
+      if (inode->data.layout == LAYOUT_EXTENTS)
+        extent_release (&inode->data);
+      else
+        free_map_release (inode->data.direct_blocks[0],
+                          bytes_to_sectors (inode->data.length));
     }
+  /* Give back the slack reserved past EOF while it was open. */
+  else if (inode->data.layout == LAYOUT_EXTENTS
+           && extent_trim (&inode->data,
+                           bytes_to_sectors (inode->data.length)))
+    cache_write (inode->sector, &inode->data);
+
+  /* Remove from inode table. */
+  lock_acquire (&open_inodes_lock);
+  hash_delete (&open_inodes, &inode->elem);
+  cond_broadcast (&open_inodes_cond, &open_inodes_lock);
+  lock_release (&open_inodes_lock);
+
+  dir_index_destroy (inode->dir_index);
+  free (inode->single);
+  free (inode->doubly);
+  free (inode->double_single);
+  free (inode);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -342,6 +681,45 @@ inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
+/* Queues the sectors following a read of INODE that covered
+   bytes START up to END for background read-ahead.  The window
+   doubles, up to READ_AHEAD_MAX sectors, for as long as reads
+   keep picking up where the previous one left off, and drops
+   back to a single sector as soon as they don't.  Readers share
+   the inode, so the window is updated under ra_lock. */
+static void
+read_ahead (struct inode *inode, off_t start, off_t end)
+{
+  off_t pos, limit;
+
+  lock_acquire (&inode->ra_lock);
+  if (start == inode->ra_next)
+    {
+      if (inode->ra_window < READ_AHEAD_MAX)
+        inode->ra_window *= 2;
+    }
+  else
+    {
+      inode->ra_window = 1;
+      inode->ra_end = 0;
+    }
+  inode->ra_next = end;
+
+  pos = ROUND_UP (end, BLOCK_SECTOR_SIZE);
+  if (pos < inode->ra_end)
+    pos = inode->ra_end;
+  limit = ROUND_UP (end, BLOCK_SECTOR_SIZE)
+          + inode->ra_window * BLOCK_SECTOR_SIZE;
+  if (limit > inode_length (inode))
+    limit = inode_length (inode);
+  if (limit > inode->ra_end)
+    inode->ra_end = ROUND_UP (limit, BLOCK_SECTOR_SIZE);
+  lock_release (&inode->ra_lock);
+
+  for (; pos < limit; pos += BLOCK_SECTOR_SIZE)
+    cache_read_ahead (byte_to_sector (inode, pos));
+}
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
@@ -350,7 +728,9 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+  off_t start = offset;
+
+  rwlock_acquire_read (&inode->rw);
   while (size > 0)
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -367,40 +747,24 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL)
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      cache_read_at (sector_idx, buffer + bytes_read, chunk_size, sector_ofs);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+  if (bytes_read > 0)
+    read_ahead (inode, start, offset);
+  rwlock_release_read (&inode->rw);
 
   return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or an error occurs.  A
+   write past end of file extends the inode. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset)
@@ -409,19 +773,37 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   int i;
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
-  if (is_denied(inode))
+  bool extending;
+  //directories are denied only to user writes, which the write system
+  //call already refuses; the directory code writes them freely
+  if (!inode_is_dir(inode) && is_denied(inode))
     return 0;
-  int sectors_to_allocate;
   int current_sectors = 0;
   int sectors_after_write = 0;
+
+  //Writes inside the file share the inode with readers and other such
+  //writers; only a write that extends the file needs it exclusively.
+  //The length only changes under the write lock, so once the read lock
+  //is held the check below is stable.
+  extending = offset + size > inode_length(inode);
+  if(extending)
+    rwlock_acquire_write(&inode->rw);
+  else{
+    rwlock_acquire_read(&inode->rw);
+    //if the upgrade had to drop the read lock, another writer may have
+    //extended the file meanwhile; the length is rechecked below anyway
+    if(offset + size > inode->data.length){
+      rwlock_upgrade(&inode->rw);
+      extending = true;
+    }
+  }
+
   //Need to allocate sectors
   if(offset + size > inode->data.length){
     //determines how many sectors the file currently has allocated and the 
     //number of sectors it needs to complete the write
     //if (offset + size) or the file's current length lies on a sector boundary
     //the number of sectors is adjusted accordingly
-    lock_acquire(&filesys_extending_lock);
   	current_sectors = inode->data.length % BLOCK_SECTOR_SIZE != 0 ? 
                       inode->data.length/BLOCK_SECTOR_SIZE + 1 : 
                       inode->data.length/BLOCK_SECTOR_SIZE;
@@ -429,16 +811,45 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                           (offset + size)/BLOCK_SECTOR_SIZE + 1 : 
                           (offset + size)/BLOCK_SECTOR_SIZE; 
   }
+  //extent-based inodes grow by whole contiguous runs; if the disk or the
+  //extent table fills up, only write as much as fits
+  if(inode->data.layout == LAYOUT_EXTENTS){
+    size_t allocated = extent_sectors(&inode->data);
+    if((size_t) sectors_after_write > allocated
+       && !extent_grow(&inode->data, sectors_after_write - allocated)){
+      off_t capacity = extent_sectors(&inode->data) * BLOCK_SECTOR_SIZE;
+      if(capacity <= offset){
+        cache_write(inode->sector, &inode->data);
+        rwlock_release_write(&inode->rw);
+        return 0;
+      }
+      size = capacity - offset;
+    }
+    //zero the sectors the file now covers, which may be slack reserved
+    //by an earlier grow
+    if(offset + size > inode->data.length)
+      extent_zero(&inode->data, bytes_to_sectors(inode->data.length),
+                  bytes_to_sectors(offset + size));
+    sectors_after_write = 0;
+  }
   //allocates the sectors needed for the write
-  for(i = current_sectors; i < sectors_after_write; i++){
-    int size_temp = size; 
+  for(i = current_sectors; i < sectors_after_write; i++)
   	allocate_sector(i, inode);
-  	size_temp -= BLOCK_SECTOR_SIZE;
-  }
 
-  inode->data.length = offset + size > inode->data.length ? offset + size : 
-                                       inode->data.length;
-  block_write(fs_device, inode->sector, &inode->data);
+  //only rewrite the inode when the write actually extends the file.
+  //Readers must not see the new length before the data behind it, so
+  //an extending write keeps the write lock until the copy is done.
+  if(offset + size > inode->data.length){
+    inode->data.length = offset + size;
+    cache_write(inode->sector, &inode->data);
+  }
+  //if another writer extended the file while this one waited for the
+  //write lock, this is an ordinary write inside the file after all,
+  //which readers may share
+  else if(extending){
+    rwlock_downgrade(&inode->rw);
+    extending = false;
+  }
 
   while (size > 0)
     {
@@ -456,32 +867,8 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
         break;
       }
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL)
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL){
-                break;
-              }
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left)
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      cache_write_at (sector_idx, buffer + bytes_written, chunk_size,
+                      sector_ofs);
 
       /* Advance. */
 
@@ -489,9 +876,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       offset += chunk_size;
       bytes_written += chunk_size;
 	}
-  free (bounce);
-  if(lock_held_by_current_thread(&filesys_extending_lock))
-    lock_release(&filesys_extending_lock);
+  if(extending)
+    rwlock_release_write(&inode->rw);
+  else
+    rwlock_release_read(&inode->rw);
   return bytes_written;
 }
 
@@ -500,8 +888,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode)
 {
+  lock_acquire (&open_inodes_lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&open_inodes_lock);
 }
 
 /* Re-enables writes to INODE.
@@ -510,9 +900,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode)
 {
+  lock_acquire (&open_inodes_lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&open_inodes_lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -522,6 +914,23 @@ inode_length (const struct inode *inode)
   return inode->data.length;
 }
 
+/* Returns a hash value for the inode that E is embedded in. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+/* Returns true if the inode that A is embedded in has a lower
+   sector number than the one B is embedded in. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
+}
+
 /*if inode_create fails due to lack of disk space, this will free the sectors
 that have been allocated*/
 void 
@@ -539,7 +948,7 @@ inode_create_failure(struct inode_disk *d_inode, int length){
     //free singleIB
     i = 0;
     struct singleIB *singly = malloc(sizeof(struct singleIB));
-    block_read(fs_device, d_inode->singleIB, singly); 
+    cache_read(d_inode->singleIB, singly); 
     while(length > 0 && i < SINGLE_BLOCKS){
     	free_map_release(singly->data_blocks[i], 1);
     	length -= BLOCK_SECTOR_SIZE;
@@ -552,66 +961,85 @@ inode_create_failure(struct inode_disk *d_inode, int length){
     //free doubleIB
     i = 0;
     struct doubleIB *doubly = malloc(sizeof(struct doubleIB));
-    block_read(fs_device, d_inode->doubleIB, doubly);
+    cache_read(d_inode->doubleIB, doubly);
     while(length > 0 && i < DOUBLE_BLOCKS){
     	int j = 0;
     	struct singleIB *doubly_singly = malloc(sizeof(struct singleIB));
-    	block_read(fs_device, doubly->single_blocks[i], doubly_singly); 
+    	cache_read(doubly->single_blocks[i], doubly_singly); 
     	while(length > 0 && j < SINGLE_BLOCKS){
     		free_map_release(doubly_singly->data_blocks[j], 1);
     		length -= BLOCK_SECTOR_SIZE;
-    		i++;
+    		j++;
     	}
     	free(doubly_singly);
+    	i++;
     }
+    free(doubly);
 
 }
 
 //Allocates a new sector for INODE, SECTOR_IDX is used to determine whether it
-//should be a direct block, part of the SingleIB, or part of the doubleIB 
+//should be a direct block, part of the SingleIB, or part of the doubleIB.
+//Index blocks are updated through the copies pinned in INODE and written
+//through to the cache.
 void allocate_sector(int sector_idx, struct inode *inode){
-	int location;
-	
-	if(!free_map_allocate(1, &location)){
+	block_sector_t location;
+	static char zeros[BLOCK_SECTOR_SIZE];
+
+	if(sector_idx >= MAX_FILE_SIZE || !free_map_allocate(1, &location)){
 		return;
 	}
-	static char zeros[BLOCK_SECTOR_SIZE];
 	if(sector_idx < DIRECT_BLOCKS){
 	  	inode->data.direct_blocks[sector_idx] = location;
-	  	block_write(fs_device, location, zeros);
-	  }
-	  else if(sector_idx <= (DIRECT_BLOCKS + SINGLE_BLOCKS)){
-	  	 struct singleIB *singly = malloc(sizeof(struct singleIB));
-	  	 block_read(fs_device, inode->data.singleIB, singly);
-	  	 singly->data_blocks[sector_idx - DIRECT_BLOCKS] = location;
-	  	 block_write(fs_device, location, zeros);
-	  	 block_write(fs_device, inode->data.singleIB, singly);
-       free(singly);
-	  }
-	  else if(sector_idx <= MAX_FILE_SIZE){
-	  	 struct doubleIB *doubly = malloc(sizeof(struct doubleIB));
-	  	 block_read(fs_device, inode->data.doubleIB, doubly);
-	  	 struct singleIB *singly = malloc(sizeof(struct singleIB));
-       int double_block_num = (sector_idx - (DIRECT_BLOCKS + SINGLE_BLOCKS));
-	  	 block_read(fs_device, 
-                doubly->single_blocks[double_block_num/DOUBLE_BLOCKS], zeros);
-	  	 singly->data_blocks[double_block_num % DOUBLE_BLOCKS] = location;
-	  	 block_write(fs_device, location, zeros);
-	  	 block_write(fs_device, 
-                doubly->single_blocks[double_block_num/DOUBLE_BLOCKS], singly);
-	  	 block_write(fs_device, inode->data.doubleIB, doubly);
-       free(singly);
-       free(doubly);
-	  }
-	  else{
+	  	cache_write(location, zeros);
 	  	return;
-	  }
+	}
 
-	return;
+	lock_acquire(&inode->index_lock);
+	if(sector_idx < DIRECT_BLOCKS + SINGLE_BLOCKS){
+	  	struct singleIB *singly = get_single(inode);
+	  	if(singly == NULL){
+	  	  free_map_release(location, 1);
+	  	}
+	  	else{
+	  	  singly->data_blocks[sector_idx - DIRECT_BLOCKS] = location;
+	  	  cache_write(location, zeros);
+	  	  cache_write(inode->data.singleIB, singly);
+	  	}
+	}
+	else{
+	  	struct doubleIB *doubly = get_double(inode);
+	  	int double_block_num = sector_idx - (DIRECT_BLOCKS + SINGLE_BLOCKS);
+	  	int single_num = double_block_num / DOUBLE_BLOCKS;
+	  	struct singleIB *singly = NULL;
+	  	//first data block under a new index block: allocate the index block
+	  	if(doubly != NULL && double_block_num % DOUBLE_BLOCKS == 0){
+	  	  block_sector_t index;
+	  	  if(free_map_allocate(1, &index)){
+	  	    doubly->single_blocks[single_num] = index;
+	  	    cache_write(index, zeros);
+	  	    cache_write(inode->data.doubleIB, doubly);
+	  	  }
+	  	  else
+	  	    doubly = NULL;
+	  	}
+	  	if(doubly != NULL)
+	  	  singly = get_double_single(inode, single_num);
+	  	if(singly == NULL){
+	  	  free_map_release(location, 1);
+	  	}
+	  	else{
+	  	  singly->data_blocks[double_block_num % DOUBLE_BLOCKS] = location;
+	  	  cache_write(location, zeros);
+	  	  cache_write(doubly->single_blocks[single_num], singly);
+	  	}
+	}
+	lock_release(&inode->index_lock);
 }
 //sets the INODE to be a directory
 void inode_set_dir(struct inode* inode){
   inode->data.is_directory=true;
+  cache_write(inode->sector, &inode->data);
 }
 //returns true if INODE represents a directory
 bool inode_is_dir(struct inode* inode){
@@ -620,20 +1048,30 @@ bool inode_is_dir(struct inode* inode){
 
 //Returns true if INODE is not writeable
 bool is_denied(struct inode* inode){
-  return inode->deny_write_cnt > 0;
+  bool denied;
+  lock_acquire(&open_inodes_lock);
+  denied = inode->deny_write_cnt > 0;
+  lock_release(&open_inodes_lock);
+  return denied;
 }
 
 //Returns the deny_cnt of INODE
 int deny_cnt(struct inode* inode){
-  return inode->deny_write_cnt;
+  int cnt;
+  lock_acquire(&open_inodes_lock);
+  cnt = inode->deny_write_cnt;
+  lock_release(&open_inodes_lock);
+  return cnt;
 }
 //increments INODE's entry count
 void add_entry(struct inode* inode){
   inode->data.entry_cnt++;
+  cache_write(inode->sector, &inode->data);
 }
 //decrements INODE's entry count
 void remove_entry(struct inode* inode){
   inode->data.entry_cnt--;
+  cache_write(inode->sector, &inode->data);
 }
 //returns INODE's entry count
 int entry_cnt(struct inode* inode){
@@ -646,4 +1084,27 @@ void remove_lock_acquire(struct inode* inode){
 
 void remove_lock_release(struct inode* inode){
    lock_release(&inode->remove_lock);
+}
+
+//Held while adding or removing entries in directory INODE, so that
+//the lookup for a name or free slot and the write that follows are
+//not interleaved with another update of the same directory
+void dir_lock_acquire(struct inode* inode){
+   lock_acquire(&inode->dir_lock);
+}
+
+void dir_lock_release(struct inode* inode){
+   lock_release(&inode->dir_lock);
+}
+
+//Returns the in-memory name index of directory INODE, or NULL if
+//none has been built; see directory.c
+struct dir_index *inode_get_dir_index(struct inode* inode){
+  return inode->dir_index;
+}
+
+//Sets the name index of directory INODE to INDEX.  INODE owns it
+//from now on and destroys it when it is closed for the last time
+void inode_set_dir_index(struct inode* inode, struct dir_index* index){
+  inode->dir_index = index;
 }
\ No newline at end of file
@@ -6,6 +6,13 @@
 #include "devices/block.h"
 
 struct bitmap;
+struct dir_index;
+
+/* If true, newly created inodes store their data as extents,
+   that is, runs of contiguous sectors, instead of in direct and
+   indirect blocks.
+   Controlled by kernel command-line option "-extents". */
+extern bool inode_extents;
 
 void inode_init (void);
 bool inode_create (block_sector_t, off_t);
@@ -23,4 +30,8 @@ bool is_denied(struct inode *);
 int deny_cnt(struct inode* inode);
 void inode_set_dir(struct inode* inode);
 bool inode_is_dir(struct inode* inode);
+void dir_lock_acquire(struct inode* inode);
+void dir_lock_release(struct inode* inode);
+struct dir_index *inode_get_dir_index(struct inode* inode);
+void inode_set_dir_index(struct inode* inode, struct dir_index* index);
 #endif /* filesys/inode.h */
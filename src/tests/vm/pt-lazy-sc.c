@@ -0,0 +1,38 @@
+/* Writes a file out of, then reads it back into, buffers in the
+   BSS segment that span several pages and have never been
+   touched.  Every page of each buffer is therefore first faulted
+   in by the kernel, inside the system call. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (5 * 4096 + 123)
+
+static char zeros[SIZE];
+static char data[SIZE];
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  int handle;
+  size_t i;
+
+  CHECK (create ("lazy", SIZE), "create \"lazy\"");
+  CHECK ((handle = open ("lazy")) > 1, "open \"lazy\"");
+  CHECK (write (handle, zeros, SIZE) == SIZE,
+         "write \"lazy\" from untouched buffer");
+
+  for (i = 0; i < SIZE; i++)
+    data[i] = i % 251;
+  seek (handle, 0);
+  CHECK (write (handle, data, SIZE) == SIZE, "write \"lazy\"");
+
+  seek (handle, 0);
+  CHECK (read (handle, buf, SIZE) == SIZE,
+         "read \"lazy\" into untouched buffer");
+  CHECK (!memcmp (data, buf, SIZE), "compare written data against read data");
+  close (handle);
+}
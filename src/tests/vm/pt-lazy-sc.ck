@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(pt-lazy-sc) begin
+(pt-lazy-sc) create "lazy"
+(pt-lazy-sc) open "lazy"
+(pt-lazy-sc) write "lazy" from untouched buffer
+(pt-lazy-sc) write "lazy"
+(pt-lazy-sc) read "lazy" into untouched buffer
+(pt-lazy-sc) compare written data against read data
+(pt-lazy-sc) end
+EOF
+pass;
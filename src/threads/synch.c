@@ -101,8 +101,22 @@ sema_try_down (struct semaphore *sema)
   return success;
 }
 
+/* Returns true if the thread that A is embedded in has a lower
+   priority than the one B is embedded in. */
+static bool
+thread_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->priority < b->priority;
+}
+
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any, preempting the running thread if the woken
+   thread outranks it.
 
    This function may be called from an interrupt handler. */
 void
@@ -114,10 +128,15 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct list_elem *e = list_max (&sema->waiters,
+                                      thread_priority_less, NULL);
+      list_remove (e);
+      thread_unblock (list_entry (e, struct thread, elem));
+    }
   sema->value++;
   intr_set_level (old_level);
+  thread_preempt ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -178,13 +197,63 @@ lock_init (struct lock *lock)
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
+  lock->priority = PRI_MIN;
   sema_init (&lock->semaphore, 1);
 }
 
+/* Makes the current thread, which holds LOCK, its holder, and
+   records the highest priority among the threads still waiting
+   for LOCK so that they keep donating to us.  Interrupts must be
+   off. */
+static void
+lock_take (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+  struct list *waiters = &lock->semaphore.waiters;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock->holder = cur;
+  lock->priority = PRI_MIN;
+  if (!list_empty (waiters) && !thread_mlfqs)
+    lock->priority = list_entry (list_max (waiters, thread_priority_less,
+                                           NULL),
+                                 struct thread, elem)->priority;
+  list_push_back (&cur->locks, &lock->elem);
+  thread_update_priority (cur);
+}
+
+/* Donates the current thread's priority to the holder of LOCK,
+   which the current thread is about to wait for, and onward to
+   the holders of the locks that holder is waiting for, up to
+   DONATION_DEPTH_MAX locks deep.  Interrupts must be off. */
+static void
+donate_priority (struct lock *lock)
+{
+  int priority = thread_current ()->priority;
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; depth < DONATION_DEPTH_MAX; depth++)
+    {
+      if (lock == NULL || lock->holder == NULL
+          || lock->priority >= priority)
+        break;
+      lock->priority = priority;
+      thread_update_priority (lock->holder);
+      lock = lock->holder->wait_lock;
+    }
+}
+
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   If LOCK is held by a lower-priority thread, the current thread
+   donates its priority to the holder until LOCK is released
+   (unless the multi-level feedback queue scheduler is in use).
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,13 +261,24 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
  // printf(" IN LOCK ACQ : B4 LOCK HELD");
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  if (lock->holder != NULL && !thread_mlfqs)
+    {
+      cur->wait_lock = lock;
+      donate_priority (lock);
+    }
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  cur->wait_lock = NULL;
+  lock_take (lock);
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -210,18 +290,22 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    lock_take (lock);
+  intr_set_level (old_level);
   return success;
 }
 
-/* Releases LOCK, which must be owned by the current thread.
+/* Releases LOCK, which must be owned by the current thread, and
+   gives up any priority donated through it.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -229,11 +313,18 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  list_remove (&lock->elem);
   lock->holder = NULL;
+  lock->priority = PRI_MIN;
+  thread_update_priority (thread_current ());
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -252,8 +343,24 @@ struct semaphore_elem
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
+/* Returns true if the thread waiting on the semaphore_elem that
+   A is embedded in has a lower priority than the one waiting on
+   B's. */
+static bool
+waiter_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct semaphore_elem *a
+    = list_entry (a_, struct semaphore_elem, elem);
+  const struct semaphore_elem *b
+    = list_entry (b_, struct semaphore_elem, elem);
+
+  return a->thread->priority < b->thread->priority;
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -296,6 +403,7 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
@@ -303,7 +411,8 @@ cond_wait (struct condition *cond, struct lock *lock)
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the highest-priority one of them to wake
+   up from its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -318,8 +427,12 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct list_elem *e = list_max (&cond->waiters,
+                                      waiter_priority_less, NULL);
+      list_remove (e);
+      sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -337,3 +450,267 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Atomically sets *P to NEW if it equals OLD.  Returns true if
+   it did.  A single locked instruction, so it needs neither
+   disabled interrupts nor a lock. */
+static inline bool
+compare_and_swap (int *p, int old, int new)
+{
+  int prev;
+
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "=a" (prev), "+m" (*p)
+                : "r" (new), "0" (old)
+                : "memory");
+  return prev == old;
+}
+
+/* Sets RWLOCK_WAITERS in RW's state, forcing every later acquire
+   and release onto the slow path, and returns the new state.
+   The caller must hold RW's lock. */
+static int
+rwlock_mark_waiters (struct rwlock *rw)
+{
+  int state;
+
+  do
+    state = rw->state;
+  while (!compare_and_swap (&rw->state, state, state | RWLOCK_WAITERS));
+  return state | RWLOCK_WAITERS;
+}
+
+/* Clears RWLOCK_WAITERS in RW's state if no thread is waiting
+   any more.  The caller must hold RW's lock. */
+static void
+rwlock_unmark_waiters (struct rwlock *rw)
+{
+  int state;
+
+  if (rw->waiting_readers > 0 || rw->waiting_writers > 0)
+    return;
+  do
+    state = rw->state;
+  while (!compare_and_swap (&rw->state, state, state & ~RWLOCK_WAITERS));
+}
+
+/* Adds DELTA to RW's state and returns the new state. */
+static int
+rwlock_add (struct rwlock *rw, int delta)
+{
+  int state;
+
+  do
+    state = rw->state;
+  while (!compare_and_swap (&rw->state, state, state + delta));
+  return state + delta;
+}
+
+/* Initializes readers-writer lock RW, which starts out free. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  rw->state = 0;
+  lock_init (&rw->lock);
+  cond_init (&rw->can_read);
+  cond_init (&rw->can_write);
+  rw->waiting_readers = 0;
+  rw->waiting_writers = 0;
+  rw->upgrading = false;
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   is waiting for it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  int state;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  state = rw->state;
+  if ((state & (RWLOCK_WRITER | RWLOCK_WAITERS)) == 0
+      && compare_and_swap (&rw->state, state, state + 1))
+    return;
+
+  lock_acquire (&rw->lock);
+  for (;;)
+    {
+      state = rwlock_mark_waiters (rw);
+      if ((state & RWLOCK_WRITER) == 0 && rw->waiting_writers == 0)
+        {
+          if (compare_and_swap (&rw->state, state, state + 1))
+            break;
+        }
+      else
+        {
+          rw->waiting_readers++;
+          cond_wait (&rw->can_read, &rw->lock);
+          rw->waiting_readers--;
+        }
+    }
+  rwlock_unmark_waiters (rw);
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread must hold for
+   reading. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  int state;
+
+  ASSERT (rw != NULL);
+
+  state = rw->state;
+  ASSERT ((state & RWLOCK_READERS) > 0);
+  if ((state & RWLOCK_WAITERS) == 0
+      && compare_and_swap (&rw->state, state, state - 1))
+    return;
+
+  lock_acquire (&rw->lock);
+  state = rwlock_add (rw, -1);
+  if (rw->upgrading)
+    {
+      /* The upgrading reader is waiting to be the last. */
+      if ((state & RWLOCK_READERS) == 1)
+        cond_broadcast (&rw->can_write, &rw->lock);
+    }
+  else if ((state & RWLOCK_READERS) == 0)
+    cond_signal (&rw->can_write, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no reader or other
+   writer holds it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  int state;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  if (compare_and_swap (&rw->state, 0, RWLOCK_WRITER))
+    return;
+
+  lock_acquire (&rw->lock);
+  rw->waiting_writers++;
+  for (;;)
+    {
+      state = rwlock_mark_waiters (rw);
+      if ((state & (RWLOCK_WRITER | RWLOCK_READERS)) == 0)
+        {
+          if (compare_and_swap (&rw->state, state, state | RWLOCK_WRITER))
+            break;
+        }
+      else
+        cond_wait (&rw->can_write, &rw->lock);
+    }
+  rw->waiting_writers--;
+  rwlock_unmark_waiters (rw);
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread must hold for writing.
+   Hands the lock to the next waiting writer if there is one, and
+   otherwise lets every waiting reader in. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (rw->state & RWLOCK_WRITER);
+
+  if (compare_and_swap (&rw->state, RWLOCK_WRITER, 0))
+    return;
+
+  lock_acquire (&rw->lock);
+  rwlock_add (rw, -RWLOCK_WRITER);
+  if (rw->waiting_writers > 0)
+    cond_signal (&rw->can_write, &rw->lock);
+  else
+    cond_broadcast (&rw->can_read, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Converts the current thread's read hold on RW into a write
+   hold, waiting for the other readers to leave.  New readers
+   wait meanwhile, as for any waiting writer.
+
+   Returns true if the thread held RW throughout.  If another
+   reader is already upgrading, the two would wait for each other
+   forever, so instead this thread releases its read hold and
+   acquires RW for writing from scratch, and returns false: the
+   caller must then recheck anything it read under the read
+   lock.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+rwlock_upgrade (struct rwlock *rw)
+{
+  int state;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT ((rw->state & RWLOCK_READERS) > 0);
+
+  if (compare_and_swap (&rw->state, 1, RWLOCK_WRITER))
+    return true;
+
+  lock_acquire (&rw->lock);
+  if (rw->upgrading)
+    {
+      lock_release (&rw->lock);
+      rwlock_release_read (rw);
+      rwlock_acquire_write (rw);
+      return false;
+    }
+  rw->upgrading = true;
+  rw->waiting_writers++;
+  for (;;)
+    {
+      state = rwlock_mark_waiters (rw);
+      if ((state & RWLOCK_READERS) == 1)
+        {
+          if (compare_and_swap (&rw->state, state,
+                                (state - 1) | RWLOCK_WRITER))
+            break;
+        }
+      else
+        cond_wait (&rw->can_write, &rw->lock);
+    }
+  rw->upgrading = false;
+  rw->waiting_writers--;
+  rwlock_unmark_waiters (rw);
+  lock_release (&rw->lock);
+  return true;
+}
+
+/* Converts the current thread's write hold on RW into a read
+   hold, without letting any writer in between, and lets waiting
+   readers in too unless a writer is waiting. */
+void
+rwlock_downgrade (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (rw->state & RWLOCK_WRITER);
+
+  if (compare_and_swap (&rw->state, RWLOCK_WRITER, 1))
+    return;
+
+  lock_acquire (&rw->lock);
+  rwlock_add (rw, 1 - RWLOCK_WRITER);
+  if (rw->waiting_writers == 0)
+    cond_broadcast (&rw->can_read, &rw->lock);
+  lock_release (&rw->lock);
+}
@@ -22,8 +22,15 @@ struct lock
   {
     struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's list of locks. */
+    int priority;               /* Highest priority donated by waiters. */
   };
 
+/* Maximum number of locks that a priority donation propagates
+   through when the holder of a lock is itself waiting on another
+   lock. */
+#define DONATION_DEPTH_MAX 8
+
 void lock_init (struct lock *);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
@@ -41,6 +48,40 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock.
+   Any number of readers may hold the lock at once, or a single
+   writer.  Waiting writers are preferred over new readers, so a
+   steady stream of readers cannot starve a writer.
+
+   STATE packs the writer bit, the waiters bit and the number of
+   readers into one word that is updated by compare-and-swap, so
+   acquiring or releasing an uncontended lock neither disables
+   interrupts nor touches a wait list.  Once any thread has to
+   wait, RWLOCK_WAITERS is set and everyone takes the slow path
+   through LOCK until the waiters are gone. */
+struct rwlock
+  {
+    int state;                  /* RWLOCK_* bits and reader count. */
+    struct lock lock;           /* Protects the members below. */
+    struct condition can_read;  /* Signaled when readers may enter. */
+    struct condition can_write; /* Signaled when a writer may enter. */
+    int waiting_readers;        /* Number of readers waiting. */
+    int waiting_writers;        /* Number of writers waiting. */
+    bool upgrading;             /* A reader is waiting to upgrade. */
+  };
+
+#define RWLOCK_WRITER  0x40000000       /* A writer holds the lock. */
+#define RWLOCK_WAITERS 0x20000000       /* Some thread is waiting. */
+#define RWLOCK_READERS 0x1fffffff       /* Mask for reader count. */
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_upgrade (struct rwlock *);
+void rwlock_downgrade (struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
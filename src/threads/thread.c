@@ -4,6 +4,8 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
@@ -21,9 +23,14 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running.  There is one FIFO queue
+   per priority, and bit N of ready_levels is set exactly when
+   ready_queues[N] is nonempty, so the highest-priority ready
+   thread can be found without scanning. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_levels;
+static int ready_cnt;           /* Number of threads in ready_queues. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -60,11 +67,21 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler. */
+#define MLFQS_PRIORITY_TICKS 4  /* # of ticks between priority updates. */
+static fixed_point load_avg;    /* Estimated # of threads ready to run. */
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
+static void ready_push (struct thread *);
+static int ready_max_priority (void);
+static int mlfqs_priority (const struct thread *);
+static void mlfqs_update_priority (struct thread *, void *aux);
+static void mlfqs_update_recent_cpu (struct thread *, void *aux);
+static void mlfqs_update_load_avg (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
@@ -88,10 +105,14 @@ static tid_t allocate_tid (void);
 void
 thread_init (void)
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (i = 0; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
+  ready_levels = 0;
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -135,6 +156,24 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    {
+      int64_t ticks = timer_ticks ();
+
+      if (t != idle_thread)
+        t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+      if (ticks % TIMER_FREQ == 0)
+        {
+          mlfqs_update_load_avg ();
+          thread_foreach (mlfqs_update_recent_cpu, NULL);
+        }
+      if (ticks % MLFQS_PRIORITY_TICKS == 0)
+        {
+          thread_foreach (mlfqs_update_priority, NULL);
+          thread_preempt ();
+        }
+    }
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
@@ -160,9 +199,8 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If PRIORITY is higher than the running thread's priority, the
+   new thread runs before thread_create() returns. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux)
@@ -206,6 +244,7 @@ thread_create (const char *name, int priority,
   /* Add to run queue. */
 
   thread_unblock (t);
+  thread_preempt ();
 
   return tid;
   //Chineye Done
@@ -246,7 +285,7 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  ready_push (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
 }
@@ -335,12 +374,30 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread)
-    list_push_back (&ready_list, &cur->elem);
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if a ready thread has a higher priority than
+   the running thread.  Within an interrupt handler, the yield
+   happens just before the handler returns instead. */
+void
+thread_preempt (void)
+{
+  enum intr_level old_level = intr_disable ();
+  bool outranked = ready_max_priority () > thread_current ()->priority;
+  intr_set_level (old_level);
+
+  if (!outranked)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else
+    thread_yield ();
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
    This function must be called with interrupts off. */
 void
@@ -358,11 +415,65 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY, and
+   yields if that leaves a higher-priority thread ready.  A
+   priority donated through a held lock still takes precedence
+   until the lock is released. */
 void
 thread_set_priority (int new_priority)
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  /* The multi-level feedback queue scheduler sets priorities
+     itself. */
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_update_priority (cur);
+  intr_set_level (old_level);
+  thread_preempt ();
+}
+
+/* Recomputes T's effective priority as the larger of its base
+   priority and the priorities donated through the locks it
+   holds, moving T to the matching run queue if it is ready.
+   Interrupts must be off. */
+void
+thread_update_priority (struct thread *t)
+{
+  struct list_elem *e;
+  int priority;
+
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  priority = t->base_priority;
+  for (e = list_begin (&t->locks); e != list_end (&t->locks);
+       e = list_next (e))
+    {
+      struct lock *l = list_entry (e, struct lock, elem);
+      if (l->priority > priority)
+        priority = l->priority;
+    }
+  if (priority == t->priority)
+    return;
+
+  if (t->status == THREAD_READY)
+    {
+      list_remove (&t->elem);
+      ready_cnt--;
+      if (list_empty (&ready_queues[t->priority]))
+        ready_levels &= ~((uint64_t) 1 << t->priority);
+      t->priority = priority;
+      ready_push (t);
+    }
+  else
+    t->priority = priority;
 }
 
 /* Returns the current thread's priority. */
@@ -372,35 +483,111 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED)
+thread_set_nice (int nice)
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  if (nice < NICE_MIN)
+    nice = NICE_MIN;
+  else if (nice > NICE_MAX)
+    nice = NICE_MAX;
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (cur, NULL);
+  intr_set_level (old_level);
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load = fp_round (load_avg * 100);
+  intr_set_level (old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu = fp_round (thread_current ()->recent_cpu * 100);
+  intr_set_level (old_level);
+  return recent_cpu;
+}
+
+/* Returns the priority that the multi-level feedback queue
+   scheduler gives T: PRI_MAX - recent_cpu / 4 - nice * 2,
+   clamped to the valid range. */
+static int
+mlfqs_priority (const struct thread *t)
+{
+  int priority = PRI_MAX - fp_trunc (t->recent_cpu / 4) - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  else if (priority > PRI_MAX)
+    return PRI_MAX;
+  else
+    return priority;
+}
+
+/* Recomputes T's priority from its recent_cpu and nice values.
+   Interrupts must be off. */
+static void
+mlfqs_update_priority (struct thread *t, void *aux UNUSED)
+{
+  if (t == idle_thread)
+    return;
+  t->base_priority = mlfqs_priority (t);
+  thread_update_priority (t);
+}
+
+/* Decays T's recent_cpu by the load average:
+   (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice.
+   Interrupts must be off. */
+static void
+mlfqs_update_recent_cpu (struct thread *t, void *aux UNUSED)
+{
+  fixed_point twice_load = load_avg * 2;
+
+  if (t == idle_thread)
+    return;
+  t->recent_cpu = fp_add_int (fp_mul (fp_div (twice_load,
+                                              fp_add_int (twice_load, 1)),
+                                      t->recent_cpu),
+                              t->nice);
+}
+
+/* Updates the load average, once per second:
+   (59/60)*load_avg + (1/60)*ready_threads, where ready_threads
+   counts the running thread too unless it is the idle thread.
+   Interrupts must be off. */
+static void
+mlfqs_update_load_avg (void)
+{
+  int ready_threads = ready_cnt;
+
+  if (thread_current () != idle_thread)
+    ready_threads++;
+  load_avg = (fp_mul (fp_div (fp_from_int (59), fp_from_int (60)), load_avg)
+              + fp_from_int (ready_threads) / 60);
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -425,6 +612,10 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Stop the periodic timer tick while we wait, unless a
+         sleeping thread is due within a tick. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -487,7 +678,16 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  if (thread_mlfqs && t != running_thread ())
+    {
+      /* Inherit the creating thread's scheduling history. */
+      struct thread *parent = running_thread ();
+      t->nice = parent->nice;
+      t->recent_cpu = parent->recent_cpu;
+      priority = mlfqs_priority (t);
+    }
+  t->priority = t->base_priority = priority;
+  list_init (&t->locks);
   t->magic = THREAD_MAGIC;
   t->exit_status = -1;
   t->fd = -1;
@@ -496,6 +696,10 @@ init_thread (struct thread *t, const char *name, int priority)
   sema_init(&(t->parent_wait_sema), 0);
   sema_init(&(t->exec_sema), 0);
   list_init(&(t->children));
+#ifdef VM
+  list_init (&t->mappings);
+  t->next_mapid = 1;
+#endif
 
   //t->working_dir = dir_open_root();
 
@@ -519,18 +723,52 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Adds T to the back of the run queue for its priority.
+   Interrupts must be off. */
+static void
+ready_push (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_levels |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
+}
+
+/* Returns the priority of the highest-priority ready thread, or
+   -1 if no thread is ready.  Interrupts must be off. */
+static int
+ready_max_priority (void)
+{
+  uint32_t hi = ready_levels >> 32;
+  uint32_t lo = ready_levels;
+
+  if (hi != 0)
+    return 63 - __builtin_clz (hi);
+  else if (lo != 0)
+    return 31 - __builtin_clz (lo);
+  else
+    return -1;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   idle_thread.  Threads of equal priority run round-robin. */
 static struct thread *
 next_thread_to_run (void)
 {
-  if (list_empty (&ready_list))
+  int pri = ready_max_priority ();
+  struct thread *t;
+
+  if (pri < 0)
     return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  t = list_entry (list_pop_front (&ready_queues[pri]), struct thread, elem);
+  ready_cnt--;
+  if (list_empty (&ready_queues[pri]))
+    ready_levels &= ~((uint64_t) 1 << pri);
+  return t;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -597,6 +835,8 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  if (cur == idle_thread)
+    timer_idle_exit ();
   if (cur != next)
     prev = switch_threads (cur, next);
   thread_schedule_tail (prev);
@@ -5,6 +5,9 @@
 #include "threads/vaddr.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -152,6 +155,17 @@ page_fault (struct intr_frame *f)
   //in the case of a page fault and these conditions, we simply exit with -1
   if(fault_addr==NULL||is_kernel_vaddr(fault_addr)||!is_user_vaddr(fault_addr))
     exit(-1);
+#ifdef VM
+  //a page that is part of the address space but not yet in memory,
+  //whether touched by the process or by a system call on its behalf
+  if(not_present && page_load(fault_addr))
+    return;
+  //a push just below the stack: grow the stack.  Faults in kernel
+  //mode happen during system calls, where f->esp is the kernel's
+  if(not_present && page_grow_stack(fault_addr,
+                                    user ? f->esp : thread_current()->user_esp))
+    return;
+#endif
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
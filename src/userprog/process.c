@@ -36,6 +36,11 @@ and exit processes, as well as creating the stack
 #include "threads/vaddr.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 
 static thread_func start_process NO_RETURN;
@@ -203,6 +208,10 @@ process_exit (void)
          directory before destroying the process's page
          directory, or our active page directory will be one
          that's been freed (and cleared). */
+#ifdef VM
+      mmap_unmap_all ();
+      page_table_destroy ();
+#endif
       cur->pagedir = NULL;
       pagedir_activate (NULL);
       pagedir_destroy (pd);
@@ -310,10 +319,22 @@ load (const char *file_name, void (**eip) (void), void **esp)
   bool success = false;
   int i;
 
+#ifdef VM
+  /* Allocate the supplemental page table, which load_segment()
+     fills in. */
+  if (!page_table_init ())
+    return false;
+#endif
+
   /* Allocate and activate page directory. */
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL)
-    goto done;
+    {
+#ifdef VM
+      page_table_destroy ();
+#endif
+      goto done;
+    }
   process_activate ();
 
   /* Open executable file. */
@@ -326,8 +347,6 @@ load (const char *file_name, void (**eip) (void), void **esp)
   char * save_ptr = NULL;
   char * fn = strtok_r(fn_temp, " ", &save_ptr);
 
-  lock_acquire(&filesys_lock); /* ensure mutex for files*/
-
   file = filesys_open (fn);
   if (file == NULL)
     {
@@ -429,7 +448,6 @@ load (const char *file_name, void (**eip) (void), void **esp)
  done:
   /* We arrive here whether the load is successful or not. */
   palloc_free_page(fn_temp);
-  lock_release(&filesys_lock);
   return success;
 
   //Chineye Done
@@ -496,6 +514,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With VM, nothing is read here: each page is only recorded in
+   the supplemental page table, and page_fault() reads it in when
+   the process first touches it.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -506,6 +528,25 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  while (read_bytes > 0 || zero_bytes > 0)
+    {
+      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+      size_t page_zero_bytes = PGSIZE - page_read_bytes;
+
+      if (!page_add_file (upage, page_read_bytes > 0 ? file : NULL, ofs,
+                          page_read_bytes, writable))
+        return false;
+
+      /* Advance. */
+      read_bytes -= page_read_bytes;
+      zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
+      upage += PGSIZE;
+    }
+  return true;
+#else
+
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0)
     {
@@ -541,6 +582,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       upage += PGSIZE;
     }
   return true;
+#endif
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -563,7 +605,11 @@ setup_stack (void **esp, const char *file_name)
   int argc, i;
 
   //Anthony Driving
+#ifdef VM
+  kpage = frame_get (PAL_ZERO);
+#else
   kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+#endif
   if (kpage != NULL){
 
     success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
@@ -693,6 +739,12 @@ setup_stack (void **esp, const char *file_name)
       palloc_free_page(temp_fn);
       palloc_free_page(argv);
       palloc_free_page(token);
+#ifdef VM
+      //only now may the stack page be evicted; until it is in the
+      //supplemental page table it would not come back
+      success = page_add_resident (((uint8_t *) PHYS_BASE) - PGSIZE,
+                                   kpage, true);
+#endif
   }
   else
     palloc_free_page (kpage);
@@ -10,17 +10,20 @@
 #include "filesys/directory.h"
 #include "threads/thread.h"
 #include "filesys/file.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 
 static void syscall_handler (struct intr_frame *);
+static bool pin_buffer (const void *buffer, unsigned size, bool write);
+static void unpin_buffer (const void *buffer, unsigned size);
 
 void
 syscall_init (void)
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
-  lock_init(&filesys_lock);
-  lock_init(&filesys_extending_lock);
-  lock_init(&create_lock);
 }
 
 /**
@@ -35,6 +38,10 @@ syscall_handler (struct intr_frame *f UNUSED)
   //Check if stack is valid
   if(!check_pointer(f->esp))
     exit(-1);
+#ifdef VM
+  //save user esp for stack growth on faults in kernel mode
+  thread_current()->user_esp = f->esp;
+#endif
 
   //Determine which syscall was made and process the call
   switch(*((uint32_t *) (f->esp))){
@@ -47,22 +54,34 @@ syscall_handler (struct intr_frame *f UNUSED)
 
     case SYS_WRITE :
       if (check_pointer(f->esp +4) 
-        && check_pointer(*(int*)(f->esp + 8)) 
-        && check_pointer(f->esp + 12))
-        f->eax = write(*((uint32_t *) (f->esp + 4) ),
-          ((void*)*(int*)(f->esp + 8) ),
-          *((unsigned *) (f->esp + 12) ));
+        && check_pointer(f->esp + 8)
+        && check_pointer(f->esp + 12)
+        && pin_buffer((void*)*(int*)(f->esp + 8),
+                      *((unsigned *) (f->esp + 12) ), false))
+        {
+          f->eax = write(*((uint32_t *) (f->esp + 4) ),
+            ((void*)*(int*)(f->esp + 8) ),
+            *((unsigned *) (f->esp + 12) ));
+          unpin_buffer((void*)*(int*)(f->esp + 8),
+                       *((unsigned *) (f->esp + 12) ));
+        }
       else
       	exit(-1);
       break;
 
     case SYS_READ :
        if (check_pointer(f->esp + 4) 
-        && check_pointer(*(int*)(f->esp + 8)) 
-        && check_pointer(f->esp + 12))
+        && check_pointer(f->esp + 8)
+        && check_pointer(f->esp + 12)
+        && pin_buffer((void*)*(int*)(f->esp + 8),
+                      *((unsigned *) (f->esp + 12) ), true))
+        {
           f->eax = read(*((uint32_t *) (f->esp + 4) ),
             ((void*)*(int*)(f->esp + 8) ),
             *((unsigned *) (f->esp + 12) ));
+          unpin_buffer((void*)*(int*)(f->esp + 8),
+                       *((unsigned *) (f->esp + 12) ));
+        }
       else
       	exit(-1);
       break;
@@ -136,9 +155,13 @@ syscall_handler (struct intr_frame *f UNUSED)
       break;
 
     case SYS_READDIR :
-      if(check_pointer(f->esp + 8))
-        f->eax = readdir((*(int*)(f->esp + 4)),
-        ((char *)*(int*)(f->esp + 8)));
+      if(check_pointer(f->esp + 8)
+        && pin_buffer((char *)*(int*)(f->esp + 8), NAME_MAX + 1, true))
+        {
+          f->eax = readdir((*(int*)(f->esp + 4)),
+          ((char *)*(int*)(f->esp + 8)));
+          unpin_buffer((char *)*(int*)(f->esp + 8), NAME_MAX + 1);
+        }
       else
         f->eax = false; //not sure whether to exit or ret. false
       break;
@@ -150,6 +173,22 @@ syscall_handler (struct intr_frame *f UNUSED)
         f->eax = false;
       break;
 
+#ifdef VM
+    case SYS_MMAP :
+      if (check_pointer(f->esp + 4) && check_pointer(f->esp + 8))
+        f->eax = mmap(*(int*)(f->esp + 4), (void *)*(int*)(f->esp + 8));
+      else
+        exit(-1);
+      break;
+
+    case SYS_MUNMAP :
+      if (check_pointer(f->esp + 4))
+        munmap(*(int*)(f->esp + 4));
+      else
+        exit(-1);
+      break;
+#endif
+
     case SYS_INUMBER :
       if (check_pointer(f->esp + 4))
         f->eax = inumber(*(int*)(f->esp +4));
@@ -174,12 +213,10 @@ chdir (const char *dir){
   struct inode* inode;
   struct dir* old_dir;
   struct dir* new_dir;
-  lock_acquire(&filesys_lock);
   //Determine parent directory of directory change
   inode=fetch_from_path(dir);
   old_dir=dir_open(inode);
   if(old_dir==NULL){
-    lock_release(&filesys_lock);
     return false;
   }
   //Check that end of path isnt a special directory
@@ -190,12 +227,10 @@ chdir (const char *dir){
     //directory found at fetch_from_path
     new_dir=dir_open(inode);
     if(new_dir==NULL){
-      lock_release(&filesys_lock);
       return false;
     }
     dir_close(thread_current()->working_dir);
     thread_current()->working_dir=new_dir;
-    lock_release(&filesys_lock);
     return true;
   }
   dir_close(old_dir);
@@ -203,17 +238,14 @@ chdir (const char *dir){
   //If not a special directory, change working directory to the direcotry
   //found at the end of path
   if(inode==NULL){
-    lock_release(&filesys_lock);
     return false;
   } else{
     new_dir=dir_open(inode);
     if(new_dir==NULL){
-      lock_release(&filesys_lock);
       return false;
     }
     dir_close(thread_current()->working_dir);
     thread_current()->working_dir=new_dir;
-    lock_release(&filesys_lock);
     return true;
   }
   
@@ -235,7 +267,6 @@ mkdir (const char *dir){
   //Determine parent directory to create new directory in
   struct dir* parent_dir = dir_open(fetch_from_path(dir));
   if(parent_dir==NULL){
-    lock_release(&filesys_lock);
     return false;
   }
   //Determine name of new directory
@@ -310,11 +341,73 @@ check_pointer (uint32_t * stack_ptr)
 {
   if (stack_ptr == NULL 
     || is_kernel_vaddr(stack_ptr) 
-    || !is_user_vaddr(stack_ptr) 
-    || pagedir_get_page(thread_current() -> pagedir, stack_ptr) == NULL)
+    || !is_user_vaddr(stack_ptr))
+    return false;
+  if (pagedir_get_page(thread_current() -> pagedir, stack_ptr) == NULL)
+#ifdef VM
+    //not in memory yet, but may still be part of the address space,
+    //or a stack buffer the stack has not grown to yet
+    return page_load(stack_ptr)
+      || page_grow_stack(stack_ptr, thread_current()->user_esp);
+#else
+    return false;
+#endif
+  return true;
+}
+
+/**
+ * Checks that every page of the SIZE bytes at BUFFER is valid user
+ * memory, writable if WRITE is true, and keeps those pages in memory
+ * until unpin_buffer().  The file system copies to and from BUFFER
+ * while holding cache and inode locks, so it must not page fault
+ * there: loading a page would take those locks again, and a bad
+ * address would exit with them held.
+ */
+static bool
+pin_buffer (const void *buffer, unsigned size, bool write UNUSED)
+{
+  const uint8_t *start = pg_round_down(buffer);
+  const uint8_t *end = (const uint8_t *) buffer + (size > 0 ? size - 1 : 0);
+  const uint8_t *upage;
+
+  if (end < (const uint8_t *) buffer || !is_user_vaddr(end))
     return false;
+  for (upage = start; upage <= end; upage += PGSIZE)
+    {
+#ifdef VM
+      if (upage == NULL || !page_pin(upage, write))
+        {
+          //unpin the pages pinned so far
+          while (upage > start)
+            {
+              upage -= PGSIZE;
+              page_unpin(upage);
+            }
+          return false;
+        }
+#else
+      if (!check_pointer((uint32_t *) upage))
+        return false;
+#endif
+    }
   return true;
 }
+
+/**
+ * Undoes pin_buffer() for the SIZE bytes at BUFFER
+ */
+static void
+unpin_buffer (const void *buffer UNUSED, unsigned size UNUSED)
+{
+#ifdef VM
+  const uint8_t *start = pg_round_down(buffer);
+  const uint8_t *end = (const uint8_t *) buffer + (size > 0 ? size - 1 : 0);
+  const uint8_t *upage;
+
+  for (upage = start; upage <= end; upage += PGSIZE)
+    page_unpin(upage);
+#endif
+}
 //Chineye Done
 
 //Tim Driving
@@ -338,9 +431,7 @@ exit (int status)
   t->exit_status = status;
   //Output exit statement
   printf("%s: exit(%d)\n",t->name,t->exit_status);
-  lock_acquire(&filesys_lock);
   file_close(t->executable);
-  lock_release(&filesys_lock);
   thread_exit();
 }
 
@@ -373,7 +464,6 @@ open (const char *file)
 {
     struct file* f_open = NULL;
     int open_spot;
-    lock_acquire(&filesys_lock);
     thread_current()->fd++;
     //Find spot for thread to store file pointer
     open_spot = getFd();
@@ -383,7 +473,6 @@ open (const char *file)
       f_open = filesys_open(file);
       thread_current()->files[open_spot] = f_open;
     }
-    lock_release(&filesys_lock);
     //Return file descriptor of file in thread(open_spot)
     if(f_open == NULL)
       return -1;
@@ -415,7 +504,6 @@ int
 read (int fd, const void *buffer, unsigned size)
 {
   int bytes_read = 0, i;
-  lock_acquire(&filesys_lock);
   struct thread* t = thread_current();
 
   //STDIN read
@@ -442,7 +530,6 @@ read (int fd, const void *buffer, unsigned size)
     //File exists
     bytes_read = file_read(t->files[fd], buffer, size);
   }
-  lock_release(&filesys_lock);
   return bytes_read;
 }
 
@@ -536,6 +623,31 @@ tell (int fd)
   file_tell(t->files[fd]);
 }
 
+#ifdef VM
+/**
+ * Maps the file open as fd into memory at addr, returns the mapping id
+ * or -1 if it can't be mapped
+ */
+mapid_t
+mmap (int fd, void *addr)
+{
+  struct thread* t = thread_current();
+  //Console descriptors and closed files can't be mapped
+  if(fd < 2 || fd >= 130 || t->files[fd] == NULL)
+    return MAP_FAILED;
+  return mmap_map(t->files[fd], addr);
+}
+
+/**
+ * Unmaps the given mapping, writing changed pages back to the file
+ */
+void
+munmap (mapid_t mapping)
+{
+  mmap_unmap(mapping);
+}
+#endif
+
 /**
  * Removes file from the current thread's file list and closes the file
  */
@@ -547,7 +659,6 @@ close (int fd)
   {
     exit(-1);
   }
-  lock_acquire(&filesys_lock);
   //Check if file exists in thread struct
   if(t->files[fd] != NULL)
   { 
@@ -555,7 +666,6 @@ close (int fd)
     file_close (t->files[fd]); 
     t->files[fd] = NULL; 
   }
-  lock_release(&filesys_lock);
 }
 
 //Randy Done
\ No newline at end of file
@@ -7,11 +7,6 @@
 #include "devices/shutdown.h"
 
 //Chineye Driving
-struct lock filesys_lock;
-struct lock create_lock;
-/*lock for extending the file*/
-struct lock filesys_extending_lock;
-
 int wait(pid_t pid);
 
 void syscall_init (void);
@@ -50,6 +45,13 @@ bool readdir (int fd, char *name);
 bool isdir (int fd);
 int inumber (int fd);
 
+#ifdef VM
+#include "vm/mmap.h"
+//virtual memory commands
+mapid_t mmap (int fd, void *addr);
+void munmap (mapid_t mapping);
+#endif
+
 
 //Chineye Done
 #endif /* userprog/syscall.h */
@@ -0,0 +1,288 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+
+/* A user-pool frame holding a page of some process. */
+struct frame
+  {
+    struct hash_elem hash_elem; /* Element in frames. */
+    struct list_elem list_elem; /* Element in clock. */
+    void *kpage;                /* Kernel virtual address. */
+    struct thread *owner;       /* Process the page belongs to. */
+    struct page *page;          /* The page held. */
+  };
+
+/* Every frame registered with frame_register(), by address and
+   in clock order.  Frames not yet registered (between
+   frame_get() and frame_register()) are not evictable. */
+static struct hash frames;
+static struct list clock;
+static struct list_elem *hand;  /* Next frame the clock examines. */
+static struct lock frame_lock;  /* Protects all of the above. */
+
+/* Signalled when a page may have become evictable or a frame has
+   gone back to the user pool.  Waited on, under frame_lock, by
+   evict() when every page is busy. */
+static struct condition frame_changed;
+
+static hash_hash_func frame_hash;
+static hash_less_func frame_less;
+static struct frame *find (void *kpage);
+static void *evict (bool *busy);
+static struct frame *pick_victim (void);
+static void insert_frame (struct frame *);
+static void remove_frame (struct frame *);
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  hash_init (&frames, frame_hash, frame_less, NULL);
+  list_init (&clock);
+  hand = list_end (&clock);
+  lock_init (&frame_lock);
+  cond_init (&frame_changed);
+}
+
+/* Returns a frame from the user pool, zeroed if FLAGS includes
+   PAL_ZERO.  If the pool is exhausted, evicts a page to make
+   room, waiting for one to become evictable if every page is
+   busy.  Returns a null pointer only if no page can be written
+   out, because swap is full or mapped files cannot be written. */
+void *
+frame_get (enum palloc_flags flags)
+{
+  for (;;)
+    {
+      void *kpage = palloc_get_page (PAL_USER | flags);
+      bool busy;
+
+      if (kpage != NULL)
+        return kpage;
+      kpage = evict (&busy);
+      if (kpage != NULL)
+        {
+          if (flags & PAL_ZERO)
+            memset (kpage, 0, PGSIZE);
+          return kpage;
+        }
+      if (!busy)
+        return NULL;
+    }
+}
+
+/* Records that KPAGE, obtained from frame_get(), holds PAGE of
+   the current process and may now be evicted.  The caller must
+   hold PAGE's lock or otherwise keep it from being evicted until
+   the page is mapped. */
+void
+frame_register (void *kpage, struct page *page)
+{
+  struct frame *f = malloc (sizeof *f);
+
+  if (f == NULL)
+    PANIC ("frame_register: out of memory");
+  f->kpage = kpage;
+  f->owner = thread_current ();
+  f->page = page;
+
+  lock_acquire (&frame_lock);
+  insert_frame (f);
+  lock_release (&frame_lock);
+}
+
+/* Wakes threads waiting in frame_get() for a page to become
+   evictable.  Call after releasing the lock of a page that is in
+   a registered frame and may now be evicted. */
+void
+frame_wake (void)
+{
+  lock_acquire (&frame_lock);
+  cond_broadcast (&frame_changed, &frame_lock);
+  lock_release (&frame_lock);
+}
+
+/* Forgets KPAGE, if it was registered, and returns it to the
+   user pool. */
+void
+frame_release (void *kpage)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = find (kpage);
+  if (f != NULL)
+    {
+      remove_frame (f);
+      free (f);
+    }
+  palloc_free_page (kpage);
+  cond_broadcast (&frame_changed, &frame_lock);
+  lock_release (&frame_lock);
+}
+
+/* Evicts a page and returns its frame, which is no longer
+   registered.  If every page is busy, waits until that may have
+   changed, then returns a null pointer with *BUSY set to true,
+   so that the caller can retry the user pool too.  Returns a
+   null pointer with *BUSY false if no page can be written out.
+
+   The victim is chosen under frame_lock, but written out after
+   releasing it, holding only the victim's page lock: writing a
+   mapped file goes through the file system's locks, and a thread
+   holding those may itself need frame_lock to fault a page in. */
+static void *
+evict (bool *busy)
+{
+  size_t failures = 0;
+
+  *busy = false;
+  for (;;)
+    {
+      struct frame *f;
+      void *kpage;
+
+      lock_acquire (&frame_lock);
+      f = failures <= hash_size (&frames) ? pick_victim () : NULL;
+      if (f == NULL)
+        {
+          /* Every page is busy only for a while: a page being
+             loaded or unpinned ends in frame_wake(), and one being
+             freed in frame_release().  Only write-out failures are
+             final. */
+          if (failures == 0)
+            {
+              *busy = true;
+              cond_wait (&frame_changed, &frame_lock);
+            }
+          lock_release (&frame_lock);
+          return NULL;
+        }
+      lock_release (&frame_lock);
+
+      if (page_evict (f->page, f->owner->pagedir, f->kpage))
+        {
+          kpage = f->kpage;
+          lock_release (&f->page->lock);
+          free (f);
+          return kpage;
+        }
+
+      /* Could not be written out.  Put it back and try another. */
+      lock_acquire (&frame_lock);
+      insert_frame (f);
+      lock_release (&frame_lock);
+      lock_release (&f->page->lock);
+      frame_wake ();
+      failures++;
+    }
+}
+
+/* Chooses a page by the second-chance clock algorithm and
+   unregisters its frame, returning it with the page's lock held,
+   so that the page stays busy while the caller writes it out.
+   Pages whose lock is held are being loaded or torn down by their
+   owner and are passed over, and so are pinned pages.  Returns a
+   null pointer if every page is busy.  The caller must hold
+   frame_lock. */
+static struct frame *
+pick_victim (void)
+{
+  size_t tries;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  /* Two sweeps clear every accessed bit, so a third finds a
+     victim unless every page is busy. */
+  for (tries = 0; tries < 3 * hash_size (&frames) + 1; tries++)
+    {
+      struct frame *f;
+      uint32_t *pd;
+
+      if (hand == list_end (&clock))
+        hand = list_begin (&clock);
+      if (hand == list_end (&clock))
+        break;
+      f = list_entry (hand, struct frame, list_elem);
+      hand = list_next (hand);
+
+      if (!lock_try_acquire (&f->page->lock))
+        continue;
+      if (f->page->pin_cnt > 0)
+        {
+          lock_release (&f->page->lock);
+          continue;
+        }
+      pd = f->owner->pagedir;
+      if (pagedir_is_accessed (pd, f->page->upage))
+        {
+          pagedir_set_accessed (pd, f->page->upage, false);
+          lock_release (&f->page->lock);
+          continue;
+        }
+      remove_frame (f);
+      return f;
+    }
+  return NULL;
+}
+
+/* Adds F to the frame table just behind the clock hand, so that
+   the clock examines it last.  The caller must hold frame_lock. */
+static void
+insert_frame (struct frame *f)
+{
+  hash_insert (&frames, &f->hash_elem);
+  list_insert (hand, &f->list_elem);
+}
+
+/* Removes F from the frame table, keeping the clock hand valid.
+   The caller must hold frame_lock. */
+static void
+remove_frame (struct frame *f)
+{
+  if (hand == &f->list_elem)
+    hand = list_next (hand);
+  list_remove (&f->list_elem);
+  hash_delete (&frames, &f->hash_elem);
+}
+
+/* Returns the registered frame at KPAGE, or a null pointer.
+   The caller must hold frame_lock. */
+static struct frame *
+find (void *kpage)
+{
+  struct frame key;
+  struct hash_elem *e;
+
+  key.kpage = kpage;
+  e = hash_find (&frames, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct frame, hash_elem) : NULL;
+}
+
+/* Returns a hash value for the frame that E is embedded in. */
+static unsigned
+frame_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (e, struct frame, hash_elem);
+  return hash_bytes (&f->kpage, sizeof f->kpage);
+}
+
+/* Returns true if the frame that A is embedded in precedes the
+   one B is embedded in. */
+static bool
+frame_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, hash_elem);
+  const struct frame *b = hash_entry (b_, struct frame, hash_elem);
+
+  return a->kpage < b->kpage;
+}
@@ -0,0 +1,14 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include "threads/palloc.h"
+
+struct page;
+
+void frame_init (void);
+void *frame_get (enum palloc_flags);
+void frame_register (void *kpage, struct page *);
+void frame_wake (void);
+void frame_release (void *kpage);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,121 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+
+/* A file mapped into a process's address space.  Its pages are
+   ordinary supplemental page table entries marked `mmap', which
+   page_load() reads from the file on first touch and which go
+   back to the file, only if dirty, when evicted or unmapped. */
+struct mapping
+  {
+    struct list_elem elem;      /* Element in thread's `mappings'. */
+    mapid_t id;                 /* Mapping identifier. */
+    struct file *file;          /* Private reopened handle. */
+    uint8_t *addr;              /* First mapped page. */
+    size_t page_cnt;            /* Number of mapped pages. */
+  };
+
+static void unmap (struct mapping *);
+
+/* Maps FILE, which must not be empty, into the current process
+   at ADDR, which must be page-aligned, nonzero, and followed by
+   enough unused user pages to hold the file.  The mapping uses a
+   reopened handle, so it outlives FILE being closed.  Returns the
+   mapping's identifier, or MAP_FAILED. */
+mapid_t
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  off_t length;
+  size_t i;
+
+  if (file == NULL || addr == NULL || pg_ofs (addr) != 0)
+    return MAP_FAILED;
+  length = file_length (file);
+  if (length <= 0)
+    return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    {
+      free (m);
+      return MAP_FAILED;
+    }
+  m->id = t->next_mapid++;
+  m->addr = addr;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+
+  /* Record each page, failing if any of them is outside user
+     space or already in use. */
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      uint8_t *upage = m->addr + i * PGSIZE;
+      off_t ofs = i * PGSIZE;
+      size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (!is_user_vaddr (upage + PGSIZE - 1)
+          || !page_add_mmap (upage, m->file, ofs, read_bytes))
+        {
+          m->page_cnt = i;
+          unmap (m);
+          return MAP_FAILED;
+        }
+    }
+  list_push_back (&t->mappings, &m->elem);
+  return m->id;
+}
+
+/* Unmaps the current process's mapping MAPPING, writing its
+   dirty pages back to the file.  Does nothing if there is no
+   such mapping. */
+void
+mmap_unmap (mapid_t mapping)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == mapping)
+        {
+          list_remove (&m->elem);
+          unmap (m);
+          return;
+        }
+    }
+}
+
+/* Unmaps all of the current process's mappings, as at exit. */
+void
+mmap_unmap_all (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_pop_front (&t->mappings),
+                       struct mapping, elem));
+}
+
+/* Removes M's pages, writing back the dirty ones, closes its
+   file and frees it.  M must not be in a list. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove (m->addr + i * PGSIZE);
+  file_close (m->file);
+  free (m);
+}
@@ -0,0 +1,387 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/share.h"
+#include "vm/swap.h"
+
+/* See page.h.  The default allows an 8 MB stack. */
+size_t page_stack_limit = 2048;
+
+/* How far below the stack pointer a push may fault.  PUSHA
+   writes 32 bytes below ESP before it decrements ESP. */
+#define STACK_SLOP 32
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_free;
+static bool write_back (struct page *, uint32_t *pd);
+
+/* Initializes the current process's supplemental page table.
+   Returns false if memory is short. */
+bool
+page_table_init (void)
+{
+  return hash_init (&thread_current ()->pages, page_hash, page_less, NULL);
+}
+
+/* Frees the current process's supplemental page table, along
+   with the frames and swap slots of its pages.  Must be called
+   before the page directory is destroyed. */
+void
+page_table_destroy (void)
+{
+  hash_destroy (&thread_current ()->pages, page_free);
+}
+
+/* Records that the page at UPAGE in the current process starts
+   out as READ_BYTES bytes read from FILE at offset OFS followed
+   by zeros, without reading anything yet.  FILE may be null if
+   READ_BYTES is 0.  Returns false if UPAGE already has an entry
+   or memory is short. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes, bool writable)
+{
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (read_bytes <= PGSIZE);
+  ASSERT (file != NULL || read_bytes == 0);
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return false;
+  p->upage = upage;
+  p->writable = writable;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->mmap = false;
+  lock_init (&p->lock);
+  p->kpage = NULL;
+  p->swap_slot = SWAP_ERROR;
+  p->anonymous = false;
+  p->pin_cnt = 0;
+  p->share = NULL;
+  if (hash_insert (&thread_current ()->pages, &p->hash_elem) != NULL)
+    {
+      free (p);
+      return false;
+    }
+  return true;
+}
+
+/* Records that UPAGE in the current process is already mapped
+   to KPAGE, a frame from frame_get() whose contents exist
+   nowhere else, and makes the frame evictable.  Returns false if
+   UPAGE already has an entry or memory is short. */
+bool
+page_add_resident (void *upage, void *kpage, bool writable)
+{
+  struct page *p;
+
+  if (!page_add_file (upage, NULL, 0, 0, writable))
+    return false;
+  p = page_lookup (upage);
+  p->kpage = kpage;
+  p->anonymous = true;
+  frame_register (kpage, p);
+  frame_wake ();
+  return true;
+}
+
+/* Records that UPAGE in the current process maps READ_BYTES
+   bytes of FILE at offset OFS, followed by zeros, and that
+   changes to those bytes are to be written back to FILE.
+   Returns false if UPAGE already has an entry or memory is
+   short. */
+bool
+page_add_mmap (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes)
+{
+  if (!page_add_file (upage, file, ofs, read_bytes, true))
+    return false;
+  page_lookup (upage)->mmap = true;
+  return true;
+}
+
+/* Removes the current process's page at UPAGE, if any, writing
+   it back first if it is a dirty mapped-file page. */
+void
+page_remove (void *upage)
+{
+  struct page *p = page_lookup (upage);
+
+  if (p != NULL)
+    {
+      hash_delete (&thread_current ()->pages, &p->hash_elem);
+      page_free (&p->hash_elem, NULL);
+    }
+}
+
+/* Returns the current process's page containing user virtual
+   address UADDR, or a null pointer if it has none. */
+struct page *
+page_lookup (const void *uaddr)
+{
+  struct page key;
+  struct hash_elem *e;
+
+  key.upage = pg_round_down (uaddr);
+  e = hash_find (&thread_current ()->pages, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Brings the current process's page containing UADDR into
+   memory and maps it.  Returns true if successful, false if
+   UADDR is not part of the address space or its contents could
+   not be read. */
+bool
+page_load (const void *uaddr)
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_lookup (uaddr);
+  uint8_t *kpage;
+  bool success = false;
+
+  if (p == NULL)
+    return false;
+
+  lock_acquire (&p->lock);
+  if (p->kpage != NULL)
+    {
+      /* Already in memory. */
+      success = true;
+      goto done;
+    }
+
+  /* Read-only pages of a file, that is, program text, map the
+     copy shared with other processes running the program. */
+  if (!p->writable && !p->mmap && p->read_bytes > 0)
+    {
+      p->share = share_acquire (p->file, p->ofs, p->read_bytes);
+      if (p->share != NULL)
+        {
+          if (!pagedir_set_page (t->pagedir, p->upage, p->share->kpage,
+                                 false))
+            {
+              share_release (p->share);
+              p->share = NULL;
+              goto done;
+            }
+          p->kpage = p->share->kpage;
+          success = true;
+          goto done;
+        }
+    }
+
+  kpage = frame_get (0);
+  if (kpage == NULL)
+    goto done;
+  if (p->swap_slot != SWAP_ERROR)
+    {
+      swap_in (p->swap_slot, kpage);
+      swap_free (p->swap_slot);
+      p->swap_slot = SWAP_ERROR;
+    }
+  else
+    {
+      if (p->read_bytes > 0
+          && file_read_at (p->file, kpage, p->read_bytes, p->ofs)
+             != (off_t) p->read_bytes)
+        {
+          frame_release (kpage);
+          goto done;
+        }
+      memset (kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+    }
+
+  if (!pagedir_set_page (t->pagedir, p->upage, kpage, p->writable))
+    {
+      frame_release (kpage);
+      goto done;
+    }
+  p->kpage = kpage;
+  frame_register (kpage, p);
+  success = true;
+
+ done:
+  lock_release (&p->lock);
+  if (success)
+    frame_wake ();
+  return success;
+}
+
+/* Extends the current process's stack down to the page holding
+   UADDR and brings that page in, if UADDR looks like a stack
+   access given user stack pointer ESP: no more than STACK_SLOP
+   bytes below ESP, and within page_stack_limit pages of the top
+   of user memory.  The new page starts out zeroed.  Returns true
+   if successful. */
+bool
+page_grow_stack (const void *uaddr, const void *esp)
+{
+  void *upage = pg_round_down (uaddr);
+
+  if (!is_user_vaddr (uaddr)
+      || (const uint8_t *) uaddr + STACK_SLOP < (const uint8_t *) esp
+      || ((size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) upage) / PGSIZE
+          > page_stack_limit))
+    return false;
+  return page_add_file (upage, NULL, 0, 0, true) && page_load (upage);
+}
+
+/* Brings the current process's page containing UADDR into
+   memory, growing the stack to it if need be, and keeps it there
+   until page_unpin(), so that the kernel can access it while
+   holding locks that a page fault would need.  If WRITE is true,
+   the page must be writable.  Returns true if successful. */
+bool
+page_pin (const void *uaddr, bool write)
+{
+  struct page *p = page_lookup (uaddr);
+
+  if (p == NULL)
+    {
+      if (!page_grow_stack (uaddr, thread_current ()->user_esp))
+        return false;
+      p = page_lookup (uaddr);
+    }
+  if (write && !p->writable)
+    return false;
+
+  /* Pin first, so that the page cannot be evicted between being
+     loaded and being pinned. */
+  lock_acquire (&p->lock);
+  p->pin_cnt++;
+  lock_release (&p->lock);
+  if (!page_load (uaddr))
+    {
+      page_unpin (uaddr);
+      return false;
+    }
+  return true;
+}
+
+/* Undoes one page_pin() of the current process's page containing
+   UADDR, making it evictable again. */
+void
+page_unpin (const void *uaddr)
+{
+  struct page *p = page_lookup (uaddr);
+
+  ASSERT (p != NULL);
+  lock_acquire (&p->lock);
+  ASSERT (p->pin_cnt > 0);
+  p->pin_cnt--;
+  lock_release (&p->lock);
+  frame_wake ();
+}
+
+/* Unmaps P, which is in KPAGE and mapped in page directory PD,
+   so that KPAGE can be reused.  If the page may differ from what
+   it was loaded from, it is written to its file or to swap
+   first.  Returns false if that fails, leaving P mapped.  The
+   caller must hold P's lock. */
+bool
+page_evict (struct page *p, uint32_t *pd, void *kpage)
+{
+  ASSERT (lock_held_by_current_thread (&p->lock));
+  ASSERT (p->kpage == kpage);
+
+  /* Unmap first, so that the owner cannot dirty the page after
+     we have looked at the dirty bit, which survives unmapping. */
+  pagedir_clear_page (pd, p->upage);
+  if (p->mmap)
+    {
+      if (!write_back (p, pd))
+        goto fail;
+    }
+  else if (p->anonymous || pagedir_is_dirty (pd, p->upage))
+    {
+      size_t slot = swap_out (kpage);
+      if (slot == SWAP_ERROR)
+        goto fail;
+      p->swap_slot = slot;
+      p->anonymous = true;
+    }
+  p->kpage = NULL;
+  return true;
+
+ fail:
+  pagedir_set_page (pd, p->upage, kpage, p->writable);
+  pagedir_set_dirty (pd, p->upage, true);
+  return false;
+}
+
+/* Writes mapped-file page P, which is in memory but already
+   unmapped from PD, back to its file if it was modified.  Only
+   the bytes that came from the file are written, so the file
+   does not grow.  Returns false if fewer bytes were written. */
+static bool
+write_back (struct page *p, uint32_t *pd)
+{
+  ASSERT (p->mmap);
+
+  return (!pagedir_is_dirty (pd, p->upage)
+          || file_write_at (p->file, p->kpage, p->read_bytes, p->ofs)
+             == (off_t) p->read_bytes);
+}
+
+/* Returns a hash value for the page that E is embedded in. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if the page that A is embedded in precedes the
+   one B is embedded in. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+
+  return a->upage < b->upage;
+}
+
+/* Frees the page that E is embedded in, with its frame or swap
+   slot, or its reference to a shared frame. */
+static void
+page_free (struct hash_elem *e, void *aux UNUSED)
+{
+  struct page *p = hash_entry (e, struct page, hash_elem);
+
+  /* Wait out an eviction in progress. */
+  lock_acquire (&p->lock);
+  if (p->kpage != NULL)
+    {
+      uint32_t *pd = thread_current ()->pagedir;
+
+      pagedir_clear_page (pd, p->upage);
+      if (p->share != NULL)
+        share_release (p->share);
+      else
+        {
+          /* Nothing can keep the page once its mapping or process
+             is gone, so a failed write loses the changes. */
+          if (p->mmap && !write_back (p, pd))
+            printf ("%s: lost changes to mapped page %p\n",
+                    thread_current ()->name, p->upage);
+          frame_release (p->kpage);
+        }
+    }
+  if (p->swap_slot != SWAP_ERROR)
+    swap_free (p->swap_slot);
+  lock_release (&p->lock);
+  free (p);
+}
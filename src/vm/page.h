@@ -0,0 +1,65 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/file.h"
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+struct share;
+
+/* A page of a process's virtual address space that is not
+   necessarily in memory.  The supplemental page table records,
+   for every page that the process may touch, where its contents
+   come from, so that page_fault() can bring it in on first
+   access instead of load() reading everything up front. */
+struct page
+  {
+    struct hash_elem hash_elem; /* Element in thread's `pages'. */
+    void *upage;                /* User virtual address. */
+    bool writable;              /* Writable by the process? */
+
+    /* Initial contents: READ_BYTES bytes from FILE at offset
+       OFS, then zeros to the end of the page.  FILE is null for
+       an all-zero page.  If MMAP is true, the page is part of a
+       memory-mapped file, and changes are written back to FILE
+       instead of to swap. */
+    struct file *file;
+    off_t ofs;
+    size_t read_bytes;
+    bool mmap;
+
+    /* Where the page is now.  LOCK is held while the page is
+       being brought in, evicted or freed. */
+    struct lock lock;
+    void *kpage;                /* Frame holding it, or null. */
+    size_t swap_slot;           /* Swap slot holding it, or SWAP_ERROR. */
+    bool anonymous;             /* Contents no longer match FILE? */
+    int pin_cnt;                /* Kept in memory while nonzero. */
+    struct share *share;        /* Shared read-only frame, or null. */
+  };
+
+/* Most pages a user stack may grow to.  Controlled by kernel
+   command-line option "-sl". */
+extern size_t page_stack_limit;
+
+bool page_table_init (void);
+void page_table_destroy (void);
+
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes, bool writable);
+bool page_add_resident (void *upage, void *kpage, bool writable);
+bool page_add_mmap (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes);
+void page_remove (void *upage);
+struct page *page_lookup (const void *uaddr);
+bool page_load (const void *uaddr);
+bool page_grow_stack (const void *uaddr, const void *esp);
+bool page_pin (const void *uaddr, bool write);
+void page_unpin (const void *uaddr);
+bool page_evict (struct page *, uint32_t *pd, void *kpage);
+
+#endif /* vm/page.h */
@@ -0,0 +1,166 @@
+#include "vm/share.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "vm/frame.h"
+
+/* Every shared page in use, by inode and offset.  A page is
+   read in when its first user maps it and freed when its last
+   user goes away. */
+static struct hash shares;
+static struct lock share_lock;  /* Protects all of the above. */
+
+/* Shared frames are never registered with the frame table, so
+   they stay in memory while in use.  To keep most of the user
+   pool evictable, at most share_max pages, a quarter of the
+   pool, are shared at once.  Past that, share_acquire() fails
+   and page_load() gives the process a private, evictable copy
+   instead. */
+static size_t share_max;
+static size_t share_cnt;        /* Pages in SHARES. */
+
+static hash_hash_func share_hash;
+static hash_less_func share_less;
+
+/* Initializes the share table. */
+void
+share_init (void)
+{
+  hash_init (&shares, share_hash, share_less, NULL);
+  lock_init (&share_lock);
+  share_max = palloc_user_page_cnt () / 4;
+}
+
+/* Returns the shared page holding READ_BYTES bytes of FILE at
+   offset OFS followed by zeros, reading it in if no process has
+   it yet, and takes a reference to it.  Returns a null pointer
+   if memory is short, the read fails, too many pages are shared
+   already, or the same page of the same file is already shared
+   with a different READ_BYTES. */
+struct share *
+share_acquire (struct file *file, off_t ofs, size_t read_bytes)
+{
+  struct share key, *s;
+  struct hash_elem *e;
+
+  ASSERT (read_bytes > 0 && read_bytes <= PGSIZE);
+
+  key.inode = file_get_inode (file);
+  key.ofs = ofs;
+
+  lock_acquire (&share_lock);
+  e = hash_find (&shares, &key.hash_elem);
+  if (e != NULL)
+    {
+      s = hash_entry (e, struct share, hash_elem);
+      if (s->read_bytes != read_bytes)
+        {
+          lock_release (&share_lock);
+          return NULL;
+        }
+      s->ref_cnt++;
+      lock_release (&share_lock);
+
+      /* Wait for the first user to finish reading it in. */
+      lock_acquire (&s->lock);
+      lock_release (&s->lock);
+      if (s->kpage == NULL)
+        {
+          share_release (s);
+          return NULL;
+        }
+      return s;
+    }
+
+  s = share_cnt < share_max ? malloc (sizeof *s) : NULL;
+  if (s == NULL)
+    {
+      lock_release (&share_lock);
+      return NULL;
+    }
+  s->inode = inode_reopen (key.inode);
+  s->ofs = ofs;
+  s->read_bytes = read_bytes;
+  s->ref_cnt = 1;
+  lock_init (&s->lock);
+  s->kpage = NULL;
+  hash_insert (&shares, &s->hash_elem);
+  share_cnt++;
+
+  /* Read it in without holding share_lock, so that other
+     programs can start meanwhile. */
+  lock_acquire (&s->lock);
+  lock_release (&share_lock);
+  s->kpage = frame_get (0);
+  if (s->kpage != NULL)
+    {
+      if (inode_read_at (s->inode, s->kpage, read_bytes, ofs)
+          == (off_t) read_bytes)
+        memset ((uint8_t *) s->kpage + read_bytes, 0, PGSIZE - read_bytes);
+      else
+        {
+          frame_release (s->kpage);
+          s->kpage = NULL;
+        }
+    }
+  lock_release (&s->lock);
+
+  if (s->kpage == NULL)
+    {
+      share_release (s);
+      return NULL;
+    }
+  return s;
+}
+
+/* Drops a reference to S, freeing it along with its frame when
+   no process uses it any longer.  The caller must already have
+   unmapped it. */
+void
+share_release (struct share *s)
+{
+  bool last;
+
+  lock_acquire (&share_lock);
+  last = --s->ref_cnt == 0;
+  if (last)
+    {
+      hash_delete (&shares, &s->hash_elem);
+      share_cnt--;
+    }
+  lock_release (&share_lock);
+
+  if (last)
+    {
+      if (s->kpage != NULL)
+        frame_release (s->kpage);
+      inode_close (s->inode);
+      free (s);
+    }
+}
+
+/* Returns a hash value for the share that E is embedded in. */
+static unsigned
+share_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct share *s = hash_entry (e, struct share, hash_elem);
+  return hash_bytes (&s->inode, sizeof s->inode) ^ hash_int (s->ofs);
+}
+
+/* Returns true if the share that A is embedded in precedes the
+   one B is embedded in. */
+static bool
+share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct share *a = hash_entry (a_, struct share, hash_elem);
+  const struct share *b = hash_entry (b_, struct share, hash_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  return a->ofs < b->ofs;
+}
@@ -0,0 +1,31 @@
+#ifndef VM_SHARE_H
+#define VM_SHARE_H
+
+#include <hash.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+struct file;
+struct inode;
+
+/* A read-only page of an executable, shared by every process
+   that maps the same page of the same inode.  Such pages hold
+   only code and constants, so one copy in memory can back them
+   all. */
+struct share
+  {
+    struct hash_elem hash_elem; /* Element in the share table. */
+    struct inode *inode;        /* Inode read from, reopened. */
+    off_t ofs;                  /* Offset in INODE. */
+    size_t read_bytes;          /* Bytes read; the rest is zeros. */
+    int ref_cnt;                /* Number of pages mapping it. */
+    struct lock lock;           /* Held while KPAGE is read in. */
+    void *kpage;                /* Frame, or null if reading failed. */
+  };
+
+void share_init (void);
+struct share *share_acquire (struct file *, off_t ofs, size_t read_bytes);
+void share_release (struct share *);
+
+#endif /* vm/share.h */
@@ -0,0 +1,78 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Swap space is the BLOCK_SWAP device carved into page-sized
+   slots of SECTORS_PER_SLOT consecutive sectors.  A bitmap
+   records which slots hold a page. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block *swap_device;       /* Null if there is none. */
+static struct bitmap *used_slots;       /* Slots in use. */
+static struct lock swap_lock;           /* Protects used_slots. */
+
+/* Initializes swap space on the BLOCK_SWAP device, if there is
+   one.  Without it, swap_out() always fails. */
+void
+swap_init (void)
+{
+  lock_init (&swap_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device == NULL)
+    {
+      printf ("swap: no swap device, pages cannot be swapped out\n");
+      return;
+    }
+  used_slots = bitmap_create (block_size (swap_device) / SECTORS_PER_SLOT);
+  if (used_slots == NULL)
+    PANIC ("swap: bitmap creation failed");
+}
+
+/* Writes the page at KPAGE to a free swap slot and returns the
+   slot, or SWAP_ERROR if swap is missing or full. */
+size_t
+swap_out (const void *kpage)
+{
+  size_t slot;
+
+  if (swap_device == NULL)
+    return SWAP_ERROR;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (used_slots, 0, 1, false);
+  lock_release (&swap_lock);
+  if (slot == BITMAP_ERROR)
+    return SWAP_ERROR;
+
+  block_write_multiple (swap_device, slot * SECTORS_PER_SLOT,
+                        SECTORS_PER_SLOT, kpage);
+  return slot;
+}
+
+/* Reads the page in swap slot SLOT into KPAGE.  The slot stays
+   in use until swap_free(). */
+void
+swap_in (size_t slot, void *kpage)
+{
+  ASSERT (swap_device != NULL);
+  ASSERT (bitmap_test (used_slots, slot));
+
+  block_read_multiple (swap_device, slot * SECTORS_PER_SLOT,
+                       SECTORS_PER_SLOT, kpage);
+}
+
+/* Marks swap slot SLOT free. */
+void
+swap_free (size_t slot)
+{
+  ASSERT (swap_device != NULL);
+
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (used_slots, slot));
+  bitmap_reset (used_slots, slot);
+  lock_release (&swap_lock);
+}